@@ -0,0 +1,156 @@
+// Throughput comparison of the portable SHA-256 backends, of the read()
+// versus mmap file paths across file sizes, and of hash_files() across
+// io_uring queue depths on a cold page cache.
+// Usage: sp_dedup_hash_bench [size_MiB=1024] [dir=.]
+//        sp_dedup_hash_bench --crossover [dir=.]
+//        sp_dedup_hash_bench --queue-depth [dir=.]
+#include "hasher.h"
+#include "sha256.h"
+#include "file_reader.h"
+#include "async_hash.h"
+#include "parallel.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static double mib_per_s(std::uintmax_t bytes, Clock::duration d) {
+    double s = std::chrono::duration<double>(d).count();
+    return s > 0 ? (double)bytes / (1024.0 * 1024.0) / s : 0.0;
+}
+
+static void fill_block(std::vector<char>& block) {
+    std::uint32_t x = 2463534242u;
+    for (auto& c : block) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; c = (char)x; }
+}
+
+// Hash ~256 MiB worth of files of each size through read() and through mmap.
+static int crossover(const fs::path& dir) {
+    std::vector<char> block(1 << 20);
+    fill_block(block);
+    const std::uintmax_t total = std::uintmax_t(256) << 20;
+    std::printf("%10s %8s %14s %14s\n", "file size", "files", "read MiB/s", "mmap MiB/s");
+    for (std::uintmax_t size = 16 << 10; size <= (std::uintmax_t(64) << 20); size *= 4) {
+        size_t count = (size_t)std::max<std::uintmax_t>(4, total / size);
+        std::vector<fs::path> paths;
+        for (size_t i = 0; i < count; ++i) {
+            paths.push_back(dir / ("sp_dedup_xover_" + std::to_string(i) + ".tmp"));
+            std::ofstream out(paths.back(), std::ios::binary | std::ios::trunc);
+            block[0] = (char)i;   // distinct contents
+            for (std::uintmax_t left = size; left; ) {
+                auto n = std::min<std::uintmax_t>(left, block.size());
+                out.write(block.data(), (std::streamsize)n);
+                left -= n;
+            }
+        }
+        double rates[2];
+        for (int mode = 0; mode < 2; ++mode) {
+            set_mmap_threshold(mode ? 0 : UINTMAX_MAX);
+            for (auto& p : paths) sha256_file(p);   // warm page cache
+            auto t0 = Clock::now();
+            for (int rep = 0; rep < 3; ++rep)
+                for (auto& p : paths) sha256_file(p);
+            rates[mode] = mib_per_s(3 * size * count, Clock::now() - t0);
+        }
+        std::printf("%10ju %8zu %14.0f %14.0f\n", size, count, rates[0], rates[1]);
+        std::error_code ec;
+        for (auto& p : paths) fs::remove(p, ec);
+    }
+    return 0;
+}
+
+// Drop the files from the page cache so every pass reads from the device.
+static void evict(const std::vector<fs::path>& paths) {
+    for (auto& p : paths) {
+        int fd = ::open(p.c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        ::fdatasync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+// Hash 512 MiB of 64 KiB..4 MiB files through hash_files() at each queue depth.
+static int queue_depth_sweep(const fs::path& dir) {
+    std::vector<char> block(1 << 20);
+    fill_block(block);
+    std::vector<fs::path> paths;
+    std::uintmax_t total = 0;
+    for (size_t i = 0; total < (std::uintmax_t(512) << 20); ++i) {
+        std::uintmax_t size = std::uintmax_t(64) << (10 + i % 7);   // 64 KiB .. 4 MiB
+        paths.push_back(dir / ("sp_dedup_qd_" + std::to_string(i) + ".tmp"));
+        std::ofstream out(paths.back(), std::ios::binary | std::ios::trunc);
+        block[0] = (char)i;
+        for (std::uintmax_t left = size; left; ) {
+            auto n = std::min<std::uintmax_t>(left, block.size());
+            out.write(block.data(), (std::streamsize)n);
+            left -= n;
+        }
+        total += size;
+    }
+    unsigned threads = default_thread_count();
+    std::printf("%zu files, %ju MiB, %u threads, io_uring %s\n", paths.size(), total >> 20, threads,
+                io_uring_available() ? "available" : "unavailable");
+    std::printf("%12s %14s\n", "queue depth", "cold MiB/s");
+    for (unsigned qd : {0u, 1u, 4u, 16u, 32u, 64u, 128u}) {
+        evict(paths);
+        auto t0 = Clock::now();
+        hash_files(paths, HashAlgo::Sha256, threads, qd);
+        std::printf("%12u %14.0f\n", qd, mib_per_s(total, Clock::now() - t0));
+    }
+    std::error_code ec;
+    for (auto& p : paths) fs::remove(p, ec);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--crossover")
+        return crossover(argc > 2 ? fs::path(argv[2]) : fs::current_path());
+    if (argc > 1 && std::string(argv[1]) == "--queue-depth")
+        return queue_depth_sweep(argc > 2 ? fs::path(argv[2]) : fs::current_path());
+
+    std::uintmax_t mib = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+    fs::path dir = argc > 2 ? fs::path(argv[2]) : fs::current_path();
+    fs::path file = dir / "sp_dedup_hash_bench.tmp";
+
+    // Deterministic pseudo-random contents so compression/dedup in the FS cannot cheat.
+    std::vector<char> block(1 << 20);
+    fill_block(block);
+    {
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        for (std::uintmax_t i = 0; i < mib; ++i) out.write(block.data(), block.size());
+        if (!out) { std::cerr << "Failed to write " << file << "\n"; return 1; }
+    }
+
+    const Sha256Backend all[] = { Sha256Backend::Scalar, Sha256Backend::Avx2, Sha256Backend::ShaNi };
+    std::printf("%-8s %14s %14s\n", "backend", "memory MiB/s", "file MiB/s");
+    for (auto b : all) {
+        if (!sha256_set_backend(b)) { std::printf("%-8s %14s %14s\n", sha256_backend_name(b), "n/a", "n/a"); continue; }
+
+        Sha256Ctx c; unsigned char out[32];
+        sha256_init(c);
+        auto t0 = Clock::now();
+        for (std::uintmax_t i = 0; i < mib; ++i) sha256_update(c, block.data(), block.size());
+        sha256_final(c, out);
+        double mem = mib_per_s(mib << 20, Clock::now() - t0);
+
+        t0 = Clock::now();
+        sha256_hex_file(file);   // page cache is warm after the write
+        double disk = mib_per_s(mib << 20, Clock::now() - t0);
+
+        std::printf("%-8s %14.0f %14.0f\n", sha256_backend_name(b), mem, disk);
+    }
+    std::error_code ec;
+    fs::remove(file, ec);
+    return 0;
+}
@@ -0,0 +1,446 @@
+// Microbenchmarks for the hot paths: directory listing, whole-file, tree-mode and
+// multi-buffer small-file hashing, zip entry read/replace and the docx/xlsx
+// in-place dedupers. Inputs are generated under a temp directory at several
+// sizes and removed on exit.
+//
+// Besides the console table, results are written as Google Benchmark JSON to
+// sp_dedup_bench.json (or wherever --benchmark_out= points), so two runs can be
+// diffed with benchmark's tools/compare.py:
+//   compare.py benchmarks before.json after.json
+// Set SP_DEDUP_BENCH_DIR to put the inputs on a particular filesystem.
+#include "file_ops.h"
+#include "hasher.h"
+#include "async_hash.h"
+#include "chunker.h"
+#include "chunk_store.h"
+#include "file_reader.h"
+#include "zip_util.h"
+#include "docx_dedup.h"
+#include "xlsx_dedup.h"
+#ifndef _WIN32
+#include "sha256.h"
+#endif
+#include <benchmark/benchmark.h>
+#include <minizip/zip.h>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+fs::path g_root;   // all generated inputs live here
+
+// xorshift32: deterministic filler so runs compare like for like.
+void fill_random(std::string& s, std::uint32_t seed) {
+    std::uint32_t x = seed ? seed : 2463534242u;
+    for (auto& c : s) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; c = (char)x; }
+}
+
+void write_file(const fs::path& p, const std::string& bytes) {
+    std::ofstream out(p, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), (std::streamsize)bytes.size());
+}
+
+/// Write a deflated zip holding `entries` (name, contents), in order.
+bool write_zip(const fs::path& p, const std::vector<std::pair<std::string, std::string>>& entries) {
+    zipFile zf = zipOpen64(p.string().c_str(), 0);
+    if (!zf) return false;
+    bool ok = true;
+    for (auto& [name, data] : entries) {
+        zip_fileinfo zi{};
+        if (ZIP_OK != zipOpenNewFileInZip64(zf, name.c_str(), &zi, nullptr, 0, nullptr, 0, nullptr,
+                                            Z_DEFLATED, Z_DEFAULT_COMPRESSION, 1)) { ok = false; break; }
+        if (!data.empty() && ZIP_OK != zipWriteInFileInZip(zf, data.data(), (unsigned)data.size())) ok = false;
+        zipCloseFileInZip(zf);
+        if (!ok) break;
+    }
+    zipClose(zf, nullptr);
+    return ok;
+}
+
+const char* kContentTypes =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+    "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\"/>";
+
+// Every other paragraph/row repeats an earlier one, so half the input is removable.
+std::string docx_xml(int paragraphs) {
+    // docx_dedupe_paragraphs_inplace() looks at the root's children, so the
+    // paragraphs sit directly under w:document.
+    std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+                      "<w:document xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\">";
+    for (int i = 0; i < paragraphs; ++i) {
+        int n = (i % 2) ? i / 2 : i;
+        xml += "<w:p><w:r><w:t>Paragraph number " + std::to_string(n) +
+               " with some ordinary body text in it.</w:t></w:r></w:p>";
+    }
+    xml += "</w:document>";
+    return xml;
+}
+
+std::string xlsx_xml(int rows) {
+    std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>"
+                      "<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\"><sheetData>";
+    for (int i = 0; i < rows; ++i) {
+        int n = (i % 2) ? i / 2 : i;
+        std::string r = std::to_string(i + 1);
+        xml += "<row r=\"" + r + "\">";
+        for (int c = 0; c < 4; ++c)
+            xml += "<c r=\"" + std::string(1, char('A' + c)) + r + "\"><v>" +
+                   std::to_string(n * 4 + c) + "</v></c>";
+        xml += "</row>";
+    }
+    xml += "</sheetData></worksheet>";
+    return xml;
+}
+
+// Inputs are built on first use and kept for the rest of the run.
+const fs::path& tree_of(int files) {
+    static std::map<int, fs::path> made;
+    auto it = made.find(files);
+    if (it != made.end()) return it->second;
+    fs::path dir = g_root / ("tree_" + std::to_string(files));
+    std::string body(64, '\0');
+    for (int i = 0; i < files; ++i) {
+        fs::path sub = dir / ("d" + std::to_string(i % 64)) / ("e" + std::to_string(i % 7));
+        fs::create_directories(sub);
+        fill_random(body, (std::uint32_t)i + 1);
+        write_file(sub / ("f" + std::to_string(i) + (i % 3 ? ".txt" : ".docx")), body);
+    }
+    return made.emplace(files, dir).first->second;
+}
+
+const fs::path& blob_of(std::int64_t bytes) {
+    static std::map<std::int64_t, fs::path> made;
+    auto it = made.find(bytes);
+    if (it != made.end()) return it->second;
+    fs::path p = g_root / ("blob_" + std::to_string(bytes) + ".bin");
+    std::string data((size_t)bytes, '\0');
+    fill_random(data, (std::uint32_t)bytes);
+    write_file(p, data);
+    return made.emplace(bytes, p).first->second;
+}
+
+// 512 distinct files of `bytes` each.
+const std::vector<fs::path>& small_files_of(std::int64_t bytes) {
+    static std::map<std::int64_t, std::vector<fs::path>> made;
+    auto it = made.find(bytes);
+    if (it != made.end()) return it->second;
+    fs::path dir = g_root / ("small_" + std::to_string(bytes));
+    fs::create_directories(dir);
+    std::vector<fs::path> paths;
+    std::string data((size_t)bytes, '\0');
+    for (int i = 0; i < 512; ++i) {
+        fill_random(data, (std::uint32_t)i + 11);
+        paths.push_back(dir / ("s" + std::to_string(i) + ".txt"));
+        write_file(paths.back(), data);
+    }
+    return made.emplace(bytes, std::move(paths)).first->second;
+}
+
+const fs::path& zip_of(std::int64_t entry_bytes) {
+    static std::map<std::int64_t, fs::path> made;
+    auto it = made.find(entry_bytes);
+    if (it != made.end()) return it->second;
+    fs::path p = g_root / ("zip_" + std::to_string(entry_bytes) + ".zip");
+    // Half random, half text, so deflate has something to do either way.
+    std::string data((size_t)entry_bytes, 'a');
+    std::string noise((size_t)entry_bytes / 2, '\0');
+    fill_random(noise, 7);
+    data.replace(0, noise.size(), noise);
+    write_zip(p, {{"[Content_Types].xml", kContentTypes},
+                  {"payload.bin", data},
+                  {"docProps/app.xml", std::string(4096, 'x')}});
+    return made.emplace(entry_bytes, p).first->second;
+}
+
+const fs::path& docx_of(int paragraphs) {
+    static std::map<int, fs::path> made;
+    auto it = made.find(paragraphs);
+    if (it != made.end()) return it->second;
+    fs::path p = g_root / ("doc_" + std::to_string(paragraphs) + ".docx");
+    write_zip(p, {{"[Content_Types].xml", kContentTypes}, {"word/document.xml", docx_xml(paragraphs)}});
+    return made.emplace(paragraphs, p).first->second;
+}
+
+const fs::path& xlsx_of(int rows) {
+    static std::map<int, fs::path> made;
+    auto it = made.find(rows);
+    if (it != made.end()) return it->second;
+    fs::path p = g_root / ("book_" + std::to_string(rows) + ".xlsx");
+    write_zip(p, {{"[Content_Types].xml", kContentTypes}, {"xl/worksheets/sheet1.xml", xlsx_xml(rows)}});
+    return made.emplace(rows, p).first->second;
+}
+
+// ---- walk ---------------------------------------------------------------
+
+void BM_ListTargetFiles(benchmark::State& st) {
+    const fs::path& dir = tree_of((int)st.range(0));
+    std::vector<std::string> exts;
+    if (st.range(2)) exts = {".docx"};
+    size_t found = 0;
+    for (auto _ : st) {
+        auto files = list_target_files(dir, true, exts, (unsigned)st.range(1));
+        found = files.size();
+        benchmark::DoNotOptimize(files.data());
+    }
+    st.counters["files"] = (double)found;
+    st.SetItemsProcessed(st.iterations() * (std::int64_t)st.range(0));
+}
+BENCHMARK(BM_ListTargetFiles)
+    ->ArgNames({"files", "threads", "ext_filter"})
+    ->ArgsProduct({{1000, 20000}, {1, 4}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// ---- hash ---------------------------------------------------------------
+
+// Warm page cache throughout: this measures the hash and read path, not the disk.
+void BM_Sha256HexFile(benchmark::State& st) {
+    const fs::path& p = blob_of(st.range(0));
+    for (auto _ : st) benchmark::DoNotOptimize(sha256_hex_file(p));
+    st.SetBytesProcessed(st.iterations() * st.range(0));
+}
+BENCHMARK(BM_Sha256HexFile)->RangeMultiplier(16)->Range(4 << 10, 64 << 20);
+
+void BM_Sha256HexBytes(benchmark::State& st) {
+    std::string data((size_t)st.range(0), '\0');
+    fill_random(data, 3);
+    for (auto _ : st) benchmark::DoNotOptimize(sha256_hex(data));
+    st.SetBytesProcessed(st.iterations() * st.range(0));
+}
+BENCHMARK(BM_Sha256HexBytes)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+// range(1): 0 = read() path, 1 = mmap path.
+void BM_HashFile(benchmark::State& st, HashAlgo algo) {
+    const fs::path& p = blob_of(st.range(0));
+    std::uintmax_t saved = mmap_threshold();
+    set_mmap_threshold(st.range(1) ? 0 : UINTMAX_MAX);
+    for (auto _ : st) benchmark::DoNotOptimize(hash_file(p, algo));
+    set_mmap_threshold(saved);
+    st.SetBytesProcessed(st.iterations() * st.range(0));
+}
+BENCHMARK_CAPTURE(BM_HashFile, sha256, HashAlgo::Sha256)
+    ->ArgNames({"bytes", "mmap"})->ArgsProduct({{4 << 10, 1 << 20, 64 << 20}, {0, 1}});
+BENCHMARK_CAPTURE(BM_HashFile, blake3, HashAlgo::Blake3)
+    ->ArgNames({"bytes", "mmap"})->ArgsProduct({{4 << 10, 1 << 20, 64 << 20}, {0, 1}});
+BENCHMARK_CAPTURE(BM_HashFile, xxh3, HashAlgo::Xxh3)
+    ->ArgNames({"bytes", "mmap"})->ArgsProduct({{4 << 10, 1 << 20, 64 << 20}, {0, 1}});
+
+// One large file as a single stream (threads=0: hash_file_range(), one core)
+// against the tree digest over 1..8 workers. Wall-clock time.
+void BM_HashFileTree(benchmark::State& st) {
+    const fs::path& p = blob_of(st.range(0));
+    for (auto _ : st) {
+        if (st.range(1)) benchmark::DoNotOptimize(hash_file_tree(p, HashAlgo::Sha256, (unsigned)st.range(1)));
+        else benchmark::DoNotOptimize(hash_file_range(p, HashAlgo::Sha256, 0, UINTMAX_MAX));
+    }
+    st.SetBytesProcessed(st.iterations() * st.range(0));
+}
+BENCHMARK(BM_HashFileTree)
+    ->ArgNames({"bytes", "threads"})->ArgsProduct({{256 << 20}, {0, 1, 2, 4, 8}})->UseRealTime();
+
+// Small files one at a time (batched=0: hash_file() per path) against the
+// multi-buffer path Phase-1 uses (batched=1: hash_files() with sizes).
+// items_per_second is files per second.
+void BM_Sha256SmallFiles(benchmark::State& st) {
+    const auto& paths = small_files_of(st.range(0));
+    std::vector<std::uintmax_t> sizes(paths.size(), (std::uintmax_t)st.range(0));
+    for (auto _ : st) {
+        if (st.range(1)) {
+            benchmark::DoNotOptimize(hash_files(paths, sizes, HashAlgo::Sha256, 1, 0));
+        } else {
+            for (auto& p : paths) benchmark::DoNotOptimize(hash_file(p, HashAlgo::Sha256));
+        }
+    }
+    st.SetItemsProcessed(st.iterations() * (std::int64_t)paths.size());
+    st.SetBytesProcessed(st.iterations() * (std::int64_t)paths.size() * st.range(0));
+}
+BENCHMARK(BM_Sha256SmallFiles)
+    ->ArgNames({"bytes", "batched"})->ArgsProduct({{4 << 10, 16 << 10, 48 << 10}, {0, 1}});
+
+#ifndef _WIN32
+// The multi-buffer core on in-memory buffers, by lane count (1 = one at a
+// time on the single-stream backend).
+void BM_Sha256Many(benchmark::State& st) {
+    auto backend = st.range(1) == 16 ? Sha256ManyBackend::Avx512x16
+                 : st.range(1) == 8  ? Sha256ManyBackend::Avx2x8 : Sha256ManyBackend::Serial;
+    auto saved = sha256_active_many_backend();
+    if (!sha256_set_many_backend(backend)) {
+        st.SkipWithError("not supported on this CPU");
+        return;
+    }
+    std::vector<std::string> bufs(256, std::string((size_t)st.range(0), '\0'));
+    for (size_t i = 0; i < bufs.size(); ++i) fill_random(bufs[i], (std::uint32_t)i + 5);
+    std::vector<const void*> data;
+    std::vector<size_t> len;
+    for (auto& b : bufs) { data.push_back(b.data()); len.push_back(b.size()); }
+    std::vector<Digest> out(bufs.size());
+    for (auto _ : st) {
+        sha256_batch(data.data(), len.data(), bufs.size(), out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    sha256_set_many_backend(saved);
+    st.SetItemsProcessed(st.iterations() * (std::int64_t)bufs.size());
+    st.SetBytesProcessed(st.iterations() * (std::int64_t)bufs.size() * st.range(0));
+}
+BENCHMARK(BM_Sha256Many)
+    ->ArgNames({"bytes", "lanes"})->ArgsProduct({{1 << 10, 16 << 10, 48 << 10}, {1, 8, 16}});
+#endif
+
+// Content-defined chunking of an in-memory buffer, by boundary-scan backend
+// (0 scalar, 1 AVX2, 2 AVX-512) and average chunk size.
+void BM_GearChunker(benchmark::State& st) {
+    auto backend = st.range(0) == 2 ? GearBackend::Avx512 : st.range(0) == 1 ? GearBackend::Avx2 : GearBackend::Scalar;
+    auto saved = gear_active_backend();
+    if (!gear_set_backend(backend)) {
+        st.SkipWithError("not supported on this CPU");
+        return;
+    }
+    std::string buf((size_t)64 << 20, '\0');
+    fill_random(buf, 11);
+    Chunker chunker((size_t)st.range(1));
+    size_t chunks = 0;
+    ChunkSink count = [&](const unsigned char*, size_t) { ++chunks; };
+    for (auto _ : st) {
+        chunker.update(buf.data(), buf.size(), count);
+        chunker.finish(count);
+    }
+    gear_set_backend(saved);
+    st.counters["chunks"] = benchmark::Counter((double)chunks / (double)st.iterations());
+    st.SetBytesProcessed(st.iterations() * (std::int64_t)buf.size());
+}
+BENCHMARK(BM_GearChunker)->ArgNames({"backend", "avg"})->ArgsProduct({{0, 1, 2}, {4 << 10, 8 << 10, 64 << 10}});
+
+// Ingest of one new 256 MiB file into an empty chunk store: read, chunk,
+// digest, compress and write overlapping on 1..8 workers. Wall-clock time.
+void BM_StoreIngest(benchmark::State& st) {
+    std::vector<StoreFile> files{{blob_of(256 << 20), "blob"}};
+    ChunkStoreOptions opt;
+    opt.threads = (unsigned)st.range(0);
+    opt.compress_level = (int)st.range(1);
+    Reporter quiet;
+    auto dir = g_root / "store";
+    for (auto _ : st) {
+        st.PauseTiming();
+        fs::remove_all(dir);
+        ChunkStore store(dir, opt);
+        st.ResumeTiming();
+        store.ingest(files, quiet);
+    }
+    fs::remove_all(dir);
+    st.SetBytesProcessed(st.iterations() * (std::int64_t)(256 << 20));
+}
+BENCHMARK(BM_StoreIngest)
+    ->ArgNames({"threads", "compress"})->ArgsProduct({{1, 2, 4, 8}, {0, 1}})->UseRealTime();
+
+// ---- zip ----------------------------------------------------------------
+
+void BM_ZipReadFile(benchmark::State& st) {
+    std::string zp = zip_of(st.range(0)).string();
+    std::string out;
+    for (auto _ : st) {
+        if (!zip_read_file(zp, "payload.bin", out)) { st.SkipWithError("zip_read_file failed"); break; }
+        benchmark::DoNotOptimize(out.data());
+    }
+    st.SetBytesProcessed(st.iterations() * st.range(0));
+}
+BENCHMARK(BM_ZipReadFile)->RangeMultiplier(16)->Range(4 << 10, 16 << 20);
+
+void BM_ZipWriteFileReplace(benchmark::State& st) {
+    fs::path work = g_root / "zip_replace_work.zip";
+    fs::copy_file(zip_of(st.range(0)), work, fs::copy_options::overwrite_existing);
+    std::string content((size_t)st.range(0), 'b');
+    for (auto _ : st) {
+        content[0] = (char)st.iterations();   // keep every rewrite distinct
+        if (!zip_write_file_replace(work.string(), "payload.bin", content)) {
+            st.SkipWithError("zip_write_file_replace failed");
+            break;
+        }
+    }
+    fs::remove(work);
+    st.SetBytesProcessed(st.iterations() * st.range(0));
+}
+BENCHMARK(BM_ZipWriteFileReplace)->RangeMultiplier(16)->Range(4 << 10, 16 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+// ---- docx / xlsx --------------------------------------------------------
+
+// range(1): 0 = analyze only, 1 = commit (a fresh copy is restored, untimed,
+// before every iteration since a committed run removes the duplicates).
+template <bool (*Dedupe)(const fs::path&, bool, std::string&)>
+void run_office_dedupe(benchmark::State& st, const fs::path& src, const char* work_name) {
+    bool commit = st.range(1) != 0;
+    fs::path work = g_root / work_name;
+    fs::copy_file(src, work, fs::copy_options::overwrite_existing);
+    std::string report;
+    for (auto _ : st) {
+        if (commit) {
+            st.PauseTiming();
+            fs::copy_file(src, work, fs::copy_options::overwrite_existing);
+            st.ResumeTiming();
+        }
+        report.clear();
+        benchmark::DoNotOptimize(Dedupe(work, commit, report));
+    }
+    fs::remove(work);
+    st.SetItemsProcessed(st.iterations() * st.range(0));
+}
+
+void BM_DocxDedupeParagraphs(benchmark::State& st) {
+    run_office_dedupe<docx_dedupe_paragraphs_inplace>(st, docx_of((int)st.range(0)), "docx_work.docx");
+}
+BENCHMARK(BM_DocxDedupeParagraphs)
+    ->ArgNames({"paragraphs", "commit"})
+    ->ArgsProduct({{100, 2000, 50000}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_XlsxDedupeRows(benchmark::State& st) {
+    run_office_dedupe<xlsx_dedupe_rows_inplace>(st, xlsx_of((int)st.range(0)), "xlsx_work.xlsx");
+}
+BENCHMARK(BM_XlsxDedupeRows)
+    ->ArgNames({"rows", "commit"})
+    ->ArgsProduct({{100, 2000, 50000}, {0, 1}})
+    ->Args({1000000, 0})        // rows fingerprinted per second at sheet scale
+    ->Unit(benchmark::kMillisecond);
+
+bool has_flag(int argc, char** argv, const std::string& prefix) {
+    for (int i = 1; i < argc; ++i)
+        if (std::string(argv[i]).rfind(prefix, 0) == 0) return true;
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // Always leave a JSON record next to the console table unless told otherwise.
+    std::vector<char*> args(argv, argv + argc);
+    std::string out_flag = "--benchmark_out=sp_dedup_bench.json";
+    std::string fmt_flag = "--benchmark_out_format=json";
+    if (!has_flag(argc, argv, "--benchmark_out=")) args.push_back(out_flag.data());
+    if (!has_flag(argc, argv, "--benchmark_out_format=")) args.push_back(fmt_flag.data());
+    int n = (int)args.size();
+    args.push_back(nullptr);
+
+    benchmark::Initialize(&n, args.data());
+    if (benchmark::ReportUnrecognizedArguments(n, args.data())) return 1;
+
+    std::error_code ec;
+    g_root = fs::temp_directory_path(ec) / ("sp_dedup_bench_" + std::to_string(std::random_device{}()));
+    if (const char* d = std::getenv("SP_DEDUP_BENCH_DIR")) g_root = fs::path(d) / "sp_dedup_bench";
+    fs::remove_all(g_root, ec);
+    fs::create_directories(g_root);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    fs::remove_all(g_root, ec);
+    return 0;
+}
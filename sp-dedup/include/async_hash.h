@@ -0,0 +1,25 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <vector>
+#include "hasher.h"
+
+/// True if the kernel lets us create an io_uring instance (Linux 5.1+, not disabled).
+bool io_uring_available();
+
+/// Full-content digests of `paths` with `algo`, same results as hash_file().
+/// With queue_depth > 0 and io_uring available, reads for up to `queue_depth`
+/// files are kept in flight at once through registered buffers and each
+/// completed buffer is hashed on one of `threads` workers. Otherwise the files
+/// are hashed on the parallel_for() pool. Unreadable files yield nullopt.
+std::vector<std::optional<Digest>> hash_files(const std::vector<std::filesystem::path>& paths,
+                                              HashAlgo algo, unsigned threads, unsigned queue_depth);
+
+/// As above, given each path's listed size: SHA-256 files of up to 64 KiB are
+/// read whole on the pool and digested in batches across SIMD lanes (see
+/// sha256_batch()); files in tree mode (uses_tree_digest()) are hashed one at
+/// a time with their chunks spread over all `threads`; the rest, and
+/// everything when the CPU has no lanes to spare, go through the path above.
+std::vector<std::optional<Digest>> hash_files(const std::vector<std::filesystem::path>& paths,
+                                              const std::vector<std::uintmax_t>& sizes,
+                                              HashAlgo algo, unsigned threads, unsigned queue_depth);
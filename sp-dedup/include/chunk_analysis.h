@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "file_ops.h"
+#include "hasher.h"
+#include "report.h"
+
+/// Sub-file duplication (--chunk-analysis): every file is cut into
+/// content-defined chunks (see chunker.h) and each chunk's digest is looked up
+/// in an index of the chunks seen so far. A chunk found there is reclaimable,
+/// and its bytes are credited to the pair (file that had it first, this file)
+/// and to this file's directory. Files are streamed; memory is the index, the
+/// pair table and one directory total per directory.
+///
+/// The index and pair table never outgrow `memory_budget`. When the index
+/// fills, it keeps only chunks whose digest lies in half the digest space
+/// (then a quarter, ...) and counts each such chunk that many times over, so
+/// the figures turn into estimates (ChunkSummaryRecord::sample_shift).
+class ChunkAnalysis {
+public:
+    /// `avg_chunk`: a power of two, 256 B to 1 MiB.
+    ChunkAnalysis(HashAlgo algo, size_t avg_chunk, std::uintmax_t memory_budget);
+    ~ChunkAnalysis();
+    ChunkAnalysis(const ChunkAnalysis&) = delete;
+    ChunkAnalysis& operator=(const ChunkAnalysis&) = delete;
+
+    /// Chunk file number `id` (ids grow with each call). False if it could not
+    /// be read; what was read of it stays in the index.
+    bool add_file(std::uint32_t id, const std::filesystem::path& p);
+
+    /// Ids of the files in the pairs report() will list, ascending.
+    std::vector<std::uint32_t> reported_files() const;
+
+    /// Send the largest pairs, every directory (in path order) and the totals
+    /// to `out`. `files` holds at least the reported_files().
+    void report(Reporter& out, const std::unordered_map<std::uint32_t, FileInfo>& files) const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include "hasher.h"
+#include "parallel.h"
+#include "report.h"
+
+/// Content-addressed chunk store (--store, `restore`). Files are cut into
+/// content-defined chunks (chunker.h); each chunk not yet in the store is
+/// compressed and appended, once, to the current segment, and each file gets
+/// a recipe listing its chunks. Layout of the store directory:
+///
+///     store.cfg               format version, digest algorithm, average chunk size
+///     segments/NNNNNNNN.seg   chunk records: raw length, stored length, codec,
+///                             digest, bytes; a new segment every 256 MiB and run
+///     index                   one record per chunk: digest -> segment, offset, lengths
+///     recipes/<name>          size, mtime and (digest, length) of each chunk, in order
+///
+/// Segment data is synced to disk before the index records that point into
+/// it, and index records before the recipes that use them, so an interrupted
+/// ingest or a crash leaves at worst unreferenced chunks. Ingest commits at
+/// each new segment and at least every 256 MiB read or 5 seconds. Chunks are never removed; a recipe
+/// written again for the same name replaces the old one. One process at a
+/// time may use a store.
+///
+/// Ingest is a pipeline: the calling thread reads and chunks files into
+/// batches, workers digest a batch (multi-buffer SHA-256 where available),
+/// claim its new chunks in batch order and compress them, and a writer thread
+/// appends batches to the segment in order. Which chunks a run stores does
+/// not depend on the thread count.
+
+/// Settings of a ChunkStore. `hash` and `chunk_size` only apply when the
+/// store is created; an existing store keeps its own.
+struct ChunkStoreOptions {
+    HashAlgo hash = HashAlgo::Sha256;       // must be cryptographic
+    size_t chunk_size = 8192;               // average chunk, power of two (chunker.h)
+    int compress_level = 1;                 // zlib level; 0 = chunks stored as they are
+    unsigned threads = default_thread_count();
+};
+
+/// A file to ingest and the name of its recipe (a relative path).
+struct StoreFile {
+    std::filesystem::path path, name;
+};
+
+class ChunkStore {
+public:
+    /// Open the store in `dir`, creating it if `dir` does not exist or is
+    /// empty. Throws std::runtime_error if `dir` holds something else or the
+    /// store cannot be read.
+    ChunkStore(const std::filesystem::path& dir, const ChunkStoreOptions& opt);
+    ~ChunkStore();
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    HashAlgo hash() const;
+    size_t chunk_size() const;
+
+    /// Ingest `files` in order and report the totals (and each file that
+    /// could not be read or recorded) to `out`. False if the store could not
+    /// be written; recipes of files whose chunks were not all saved are not
+    /// written. A file whose name an earlier file already has is reported
+    /// and not read.
+    bool ingest(const std::vector<StoreFile>& files, Reporter& out);
+
+    /// Recreate every recipe's file under `target`, verifying each chunk's
+    /// digest, and report the totals (and each file that failed) to `out`.
+    /// Existing files are replaced. False if any file failed.
+    bool restore(const std::filesystem::path& target, Reporter& out);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
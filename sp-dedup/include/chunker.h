@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Content-defined chunking (FastCDC with normalized chunking). A boundary may
+// follow byte i when the Gear hash of the 64 bytes ending at i has its top
+// mask bits clear: before the average size a stricter mask (two more bits)
+// applies, after it a looser one (two fewer), which pulls chunk sizes toward
+// the average. The hash of a position depends only on that 64-byte window,
+// never on where the chunk started, so candidates are found for a whole
+// buffer at once, in SIMD lanes that each take a slice of it.
+
+enum class GearBackend { Scalar, Avx2, Avx512 };
+
+const char* gear_backend_name(GearBackend b);
+bool gear_backend_supported(GearBackend b);
+GearBackend gear_active_backend();
+/// Override the dispatched backend (benchmarks). Returns false if unsupported.
+bool gear_set_backend(GearBackend b);
+
+/// A possible cut after byte `pos`; `strong` if it also passes the stricter mask.
+struct GearCandidate {
+    std::uint32_t pos;
+    bool strong;
+};
+
+/// Append to `out`, in order, every position in [begin, end) of `data` whose
+/// window hash passes `loose_mask` (and flag those passing `strict_mask`, which
+/// must contain it). The window never reaches before data[0]; callers keep 64
+/// bytes of history in front of `begin` unless data[0] starts the stream.
+/// `end` must fit in 32 bits.
+void gear_candidates(const unsigned char* data, size_t begin, size_t end,
+                     std::uint64_t loose_mask, std::uint64_t strict_mask, std::vector<GearCandidate>& out);
+
+using ChunkSink = std::function<void(const unsigned char* data, size_t n)>;
+
+/// Streaming chunker: feed a file's bytes in any pieces and get the same
+/// chunks. Chunks are avg/4 to avg*8 bytes long (the last may be shorter).
+/// Holds at most about 1 MiB plus one maximum chunk.
+class Chunker {
+public:
+    /// `avg_size` must be a power of two, 256 B to 1 MiB.
+    explicit Chunker(size_t avg_size = 8192);
+
+    size_t min_size() const { return min_; }
+    size_t avg_size() const { return avg_; }
+    size_t max_size() const { return max_; }
+
+    /// Feed the next bytes; `emit` gets every chunk completed by them. The
+    /// pointer is valid during the call only.
+    void update(const void* data, size_t n, const ChunkSink& emit);
+
+    /// Emit the rest as the final chunk and start over for the next stream.
+    void finish(const ChunkSink& emit);
+
+private:
+    void cut(bool last, const ChunkSink& emit);
+
+    size_t min_, avg_, max_;
+    std::uint64_t loose_, strict_;
+    std::vector<unsigned char> buf_;        // history, then bytes not yet emitted
+    size_t start_ = 0;                      // current chunk's first byte in buf_
+    size_t scanned_ = 0;                    // candidates found up to here
+    std::vector<GearCandidate> cands_;
+    size_t nextCand_ = 0;
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/// What Phase-1 does with each duplicate once the KEEP file is chosen.
+enum class DedupAction {
+    Delete,     // remove the path
+    Hardlink,   // replace the path with a hard link to KEEP (same filesystem)
+    Reflink,    // share KEEP's extents with FIDEDUPERANGE; the path is untouched
+};
+
+/// "delete", "hardlink" or "reflink". Returns false for anything else.
+bool parse_dedup_action(const std::string& name, DedupAction& out);
+
+const char* dedup_action_name(DedupAction a);
+
+/// Replace `dup` with a hard link to `keep`: link to a temp name next to `dup`,
+/// then rename it over `dup`, so the path always exists. Fails with EXDEV
+/// across filesystems, ENOTSUP if either path is a symlink, and EEXIST if
+/// both already name the same inode; nothing is touched then. `dup`'s own
+/// owner and mode are not kept.
+bool hardlink_replace(const std::filesystem::path& keep, const std::filesystem::path& dup,
+                      std::error_code& ec);
+
+enum class ReflinkStatus { Shared, Differs, Failed };
+
+/// Share `keep`'s extents with every file in `dups` (all the same size as `keep`)
+/// using FIDEDUPERANGE. The kernel locks and compares both ranges before sharing
+/// them, so a file that differs is reported and left alone. One ioctl covers
+/// the whole set per 16 MiB chunk. Linux only (btrfs, XFS); elsewhere every
+/// entry is Failed.
+std::vector<ReflinkStatus> reflink_dedupe(const std::filesystem::path& keep,
+                                          const std::vector<std::filesystem::path>& dups);
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include "file_ops.h"
+
+/// File records sorted by (size, path) in bounded memory. Records are buffered
+/// until they outgrow `budget` bytes, then sorted and spilled to a run file in
+/// `tmp_dir`; reading merges the runs and hands out one size group at a time.
+/// Run files are removed by the destructor.
+class ExternalFileSort {
+public:
+    ExternalFileSort(std::filesystem::path tmp_dir, size_t budget);
+    ~ExternalFileSort();
+    ExternalFileSort(const ExternalFileSort&) = delete;
+    ExternalFileSort& operator=(const ExternalFileSort&) = delete;
+
+    /// Buffer one record, spilling a run if the buffer is full. False on a write error.
+    bool add(FileInfo f);
+
+    /// Stop adding and start reading from the smallest size. Can be called again
+    /// to read everything a second time. False on an I/O error.
+    bool rewind();
+
+    /// The next group of records sharing one size, in path order. False at the end.
+    bool next_group(std::vector<FileInfo>& group);
+
+    size_t runs() const { return runs_.size(); }
+    std::uint64_t records() const { return records_; }
+
+private:
+    struct Reader;
+
+    bool spill();
+    bool merge_runs(size_t first, size_t count);   // replaces runs_[first, first+count) with one run
+    std::filesystem::path new_run_path();
+
+    std::filesystem::path dir_;
+    size_t budget_;
+    std::vector<FileInfo> buf_;
+    size_t bufBytes_ = 0;
+    size_t pos_ = 0;                                // read position in buf_ when nothing spilled
+    std::vector<std::filesystem::path> runs_;
+    std::vector<std::unique_ptr<Reader>> readers_;  // one per run while reading
+    std::vector<size_t> heap_;                      // reader indices, smallest head on top
+    std::uint64_t records_ = 0;
+    unsigned nextRun_ = 0;
+};
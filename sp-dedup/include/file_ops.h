@@ -1,17 +1,40 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <functional>
 
 struct FileInfo {
     std::filesystem::path path;
     std::uintmax_t size{};
+    std::uint64_t dev{}, ino{};     // identity of the inode; set on Windows only when nlink > 1
+    std::uint32_t nlink{1};         // paths sharing dev/ino are one file on disk
 };
 
+/// Whether `f` carries its inode identity, so paths can be compared by it.
+inline bool has_inode(const FileInfo& f) { return f.dev != 0 || f.ino != 0; }
+
+/// Stream every regular file in `dir` (and its subdirectories when `recurse`)
+/// whose extension is in `only_exts` (any, if empty) to `sink`. Directories are
+/// spread over `threads` walkers that steal from each other's queues. `sink` runs
+/// on walker threads, one call at a time, in no particular order. Directory
+/// symlinks are not followed, file symlinks are skipped, and unreadable
+/// directories are skipped.
+void walk_target_files(const std::filesystem::path& dir, bool recurse,
+                       const std::vector<std::string>& only_exts, unsigned threads,
+                       const std::function<void(FileInfo&&)>& sink);
+
+/// walk_target_files() collected into a vector sorted by path, so the listing
+/// order does not depend on the thread count.
 std::vector<FileInfo> list_target_files(const std::filesystem::path& dir, bool recurse,
-                                        const std::vector<std::string>& only_exts);
+                                        const std::vector<std::string>& only_exts,
+                                        unsigned threads = 1);
 
 bool delete_file(const std::filesystem::path& p);
 
+/// Byte-for-byte comparison of two files. False if they differ or either cannot be read.
+bool files_identical(const std::filesystem::path& a, const std::filesystem::path& b);
+
 // Phase 2 helpers
 bool dedupe_txt_inplace(const std::filesystem::path& p);
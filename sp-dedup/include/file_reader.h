@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+// Shared read path for everything that hashes file contents. Regular files at
+// or above the mmap threshold are mapped (MADV_SEQUENTIAL, optionally
+// MADV_HUGEPAGE); smaller files, special files and filesystems that refuse
+// mmap go through plain read() into a reused buffer.
+
+/// Files of at least `bytes` are mapped instead of read (UINTMAX_MAX disables mmap).
+void set_mmap_threshold(std::uintmax_t bytes);
+std::uintmax_t mmap_threshold();
+
+/// Ask for transparent huge pages on mapped files (Linux only; a hint).
+void set_mmap_hugepages(bool on);
+
+/// Feed bytes [offset, offset+len) of `p` (clamped at EOF) to `sink` in order.
+/// Throws std::runtime_error on open/read errors, including a regular file
+/// that shrinks while it is read. For a mapped one, a SIGBUS handler
+/// (installed on first use, chained to any earlier one) turns the lost pages
+/// into zeros until the sink returns.
+void read_file_range(const std::filesystem::path& p, std::uintmax_t offset, std::uintmax_t len,
+                     const std::function<void(const void* data, size_t n)>& sink);
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include "hasher.h"
+#include "prefilter.h"
+
+/// What stat() says about a file; any change to it invalidates a cached digest.
+struct FileStamp {
+    std::uint64_t dev{}, ino{}, size{};
+    std::int64_t mtime_ns{}, ctime_ns{};
+};
+
+/// stat() `p`. Returns false if the file cannot be stat'ed.
+bool file_stamp(const std::filesystem::path& p, FileStamp& out);
+
+/// On-disk cache of full-content digests keyed by (dev, ino, size, mtime, ctime, algo).
+/// Tree-mode digests (uses_tree_digest() at the time of the call) are kept
+/// apart from plain ones, so changing the tree threshold never serves the
+/// wrong kind. Prefilter sample digests are kept too, per round kind and
+/// sample length, so files the prefilter eliminates are not read again on the
+/// next run. Not thread-safe: Phase-1 looks up before hashing and stores after merging.
+class HashCache {
+public:
+    /// Load entries from `path`. A missing file is an empty cache; a corrupt or
+    /// foreign one is ignored (returns false) and overwritten on save().
+    bool load(const std::filesystem::path& path);
+
+    /// Write the entries that were hit or stored during this run; stale ones are
+    /// dropped. Writes a temp file and renames it over `path`.
+    bool save(const std::filesystem::path& path) const;
+
+    bool lookup(const FileStamp& st, HashAlgo algo, Digest& digest);
+    void store(const FileStamp& st, HashAlgo algo, const Digest& digest);
+
+    /// The same for one prefilter sample. Not counted in hits() / misses().
+    bool lookup_sample(const FileStamp& st, HashAlgo algo, const PrefilterRound& r, Digest& digest);
+    void store_sample(const FileStamp& st, HashAlgo algo, const PrefilterRound& r, const Digest& digest);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    struct Key {
+        FileStamp st;
+        HashAlgo algo;
+        bool tree;
+        std::uint8_t part = 0;          // 0: whole file; else 1 + PrefilterRound::Kind
+        std::uint64_t sample = 0;       // sample length when part != 0
+        bool operator==(const Key& o) const {
+            return st.dev == o.st.dev && st.ino == o.st.ino && st.size == o.st.size &&
+                   st.mtime_ns == o.st.mtime_ns && st.ctime_ns == o.st.ctime_ns && algo == o.algo &&
+                   tree == o.tree && part == o.part && sample == o.sample;
+        }
+    };
+    struct KeyHash { size_t operator()(const Key& k) const; };
+
+    std::unordered_map<Key, Digest, KeyHash> loaded_;   // from disk
+    std::unordered_map<Key, Digest, KeyHash> live_;     // seen this run
+    size_t hits_ = 0, misses_ = 0;
+};
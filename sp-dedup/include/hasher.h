@@ -1,9 +1,136 @@
 #pragma once
 #include <string>
 #include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <memory>
+
+/// Raw digest bytes. SHA-256 and BLAKE3 fill all 32; XXH3-128 fills the first 16
+/// and leaves the rest zero.
+using Digest = std::array<unsigned char, 32>;
+
+/// Hasher for unordered containers keyed by Digest (the bytes are already uniform).
+struct DigestHash {
+    size_t operator()(const Digest& d) const {
+        size_t h;
+        std::memcpy(&h, d.data(), sizeof(h));
+        return h;
+    }
+};
 
 /// Compute SHA256 of in-memory bytes (hex string).
 std::string sha256_hex(const std::string& bytes);
 
 /// Compute SHA256 of a file and return hex string. Throws std::runtime_error on I/O error.
 std::string sha256_hex_file(const std::filesystem::path& p);
+
+/// Raw SHA256 of a whole file / of `len` bytes starting at `offset` (clamped at EOF).
+/// Throws std::runtime_error on I/O error.
+Digest sha256_file(const std::filesystem::path& p);
+Digest sha256_file_range(const std::filesystem::path& p, std::uintmax_t offset, std::uintmax_t len);
+
+/// Raw SHA256 of in-memory bytes, without per-call backend setup (fingerprints).
+Digest sha256(const void* data, size_t n);
+
+/// Incremental SHA256 on the platform backend. Reusable: finish() leaves the
+/// hasher empty for the next message, so hot loops keep one (see thread_sha256()).
+class Sha256Hasher {
+public:
+    Sha256Hasher();
+    ~Sha256Hasher();
+    Sha256Hasher(const Sha256Hasher&) = delete;
+    Sha256Hasher& operator=(const Sha256Hasher&) = delete;
+
+    void update(const void* data, size_t n);
+    /// Digest of everything since construction or the last finish()/reset().
+    Digest finish();
+    /// Drop whatever was fed since the last finish().
+    void reset();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/// This thread's Sha256Hasher, reset and ready to feed. Finish with it before
+/// calling anything else that may use it.
+Sha256Hasher& thread_sha256();
+
+/// SHA-256 of `n` whole in-memory buffers at once: out[i] = digest of
+/// data[i][0, len[i]). The portable backend hashes them side by side in SIMD
+/// lanes (AVX2 or AVX-512); CNG hashes them one at a time.
+void sha256_batch(const void* const* data, const size_t* len, size_t n, Digest* out);
+
+/// Buffers sha256_batch() hashes at once on this CPU; 1 means batching buys nothing.
+size_t sha256_batch_lanes();
+
+// Pluggable algorithm layer used by Phase-1 (--hash=). SHA-256 goes through the
+// platform backend above; BLAKE3 and XXH3-128 come from their reference libraries.
+enum class HashAlgo { Sha256, Blake3, Xxh3 };
+
+/// Parse "sha256", "blake3" or "xxh3". Returns false for an unknown name.
+bool parse_hash_algo(const std::string& name, HashAlgo& out);
+
+const char* hash_algo_name(HashAlgo a);
+
+/// False for algorithms without collision resistance (xxh3): equal digests must
+/// be confirmed byte-for-byte before anything destructive is done.
+bool hash_algo_is_cryptographic(HashAlgo a);
+
+/// Incremental hashing with any HashAlgo (used by readers that own the I/O).
+class HashState {
+public:
+    explicit HashState(HashAlgo a);
+    ~HashState();
+    HashState(const HashState&) = delete;
+    HashState& operator=(const HashState&) = delete;
+
+    void update(const void* data, size_t n);
+    Digest finish();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/// Digest length in bytes (32, or 16 for xxh3).
+size_t hash_algo_digest_size(HashAlgo a);
+
+/// Hex of the meaningful bytes of `d`.
+std::string digest_hex(const Digest& d, HashAlgo a);
+
+/// Digest of in-memory bytes with `a` (chunk fingerprints).
+Digest hash_bytes(HashAlgo a, const void* data, size_t n);
+
+/// Hash a whole file / a byte range of it with `a`.
+/// Throws std::runtime_error on I/O error.
+Digest hash_file(const std::filesystem::path& p, HashAlgo a);
+Digest hash_file_range(const std::filesystem::path& p, HashAlgo a,
+                       std::uintmax_t offset, std::uintmax_t len);
+
+// Tree mode for very large files: the file is cut into fixed 16 MiB chunks,
+// each chunk is hashed on its own (in parallel), and the root is
+//   H(0x01 || u64le(file size) || leaf_0 || leaf_1 || ...), leaf_i = H(0x00 || chunk_i)
+// with H = the selected algorithm and each leaf its digest_size() bytes. The
+// chunk size is part of the definition, so the digest does not depend on how
+// many threads computed it. It differs from the plain digest of the same bytes.
+
+/// Files larger than this get the tree digest from hash_file(); 0 = never.
+/// Default 1 GiB.
+void set_tree_threshold(std::uintmax_t bytes);
+std::uintmax_t tree_threshold();
+
+/// True if hash_file() uses the tree digest for a file of `size` bytes.
+bool uses_tree_digest(std::uintmax_t size);
+
+/// Workers hash_file() spreads one tree-mode file over; 0 = default_thread_count().
+void set_tree_threads(unsigned n);
+
+/// Tree digest of a whole file, its chunks hashed on up to `threads` workers.
+/// Throws std::runtime_error on I/O error.
+Digest hash_file_tree(const std::filesystem::path& p, HashAlgo a, unsigned threads);
+
+/// Name of the digest hash_file() reports for a file of `size` bytes: the
+/// algorithm's name, with a "-tree" suffix in tree mode (e.g. "sha256-tree").
+const char* digest_name(HashAlgo a, std::uintmax_t size);
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+/// Partition same-size files by content. Every member is read in lockstep, one
+/// aligned block at a time, and a class splits the moment its members' blocks
+/// differ; a member left alone is closed and no longer read. Returns classes of
+/// indices into `paths` (ascending, classes ordered by first member), including
+/// singletons. Unreadable files go to `failed` instead.
+///
+/// At most `max_open` files are open at once: larger sets are compared in
+/// batches and the batches' classes merged by comparing their first members.
+/// Blocks are `block` bytes, shrunk so that all buffers fit in `budget` bytes.
+std::vector<std::vector<size_t>> lockstep_compare(const std::vector<std::filesystem::path>& paths,
+                                                  std::vector<size_t>& failed,
+                                                  size_t block = size_t(1) << 20,
+                                                  size_t budget = size_t(64) << 20,
+                                                  size_t max_open = 256);
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+/// Number of workers used when --threads is not given (hardware concurrency, at least 1).
+unsigned default_thread_count();
+
+/// Run fn(i) for every i in [0,n) on a pool of up to `threads` workers that pull
+/// indices from a shared counter. Blocks until every call has returned.
+/// fn must not throw; callers write results into slot i so the merge order
+/// does not depend on scheduling.
+void parallel_for(size_t n, unsigned threads, const std::function<void(size_t)>& fn);
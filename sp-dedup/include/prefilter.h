@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "file_ops.h"
+#include "hasher.h"
+
+/// One sampling round of the Phase-1 prefilter.
+struct PrefilterRound {
+    enum Kind { Head, Tail, Middle, Prefix } kind;
+    std::uintmax_t bytes;
+};
+
+struct PrefilterRoundStats {
+    PrefilterRound round;
+    size_t sampled = 0;     // files hashed in this round
+    size_t cached = 0;      // files whose sample came from a SampleCache
+    size_t eliminated = 0;  // files found unique by this round
+};
+
+/// Sample digests kept from an earlier run (the hash cache), by index into
+/// `files`. Called on the calling thread only: lookups before a round's reads,
+/// stores after them.
+struct SampleCache {
+    std::function<bool(size_t file, const PrefilterRound& r, Digest& digest)> lookup;
+    std::function<void(size_t file, const PrefilterRound& r, const Digest& digest)> store;
+};
+
+/// Round schedule: head, tail and middle samples of `sample` bytes, then prefixes
+/// growing 16x per round. At most `rounds` entries; 0 disables the prefilter.
+std::vector<PrefilterRound> make_prefilter_rounds(size_t rounds, std::uintmax_t sample);
+
+const char* prefilter_round_name(PrefilterRound::Kind k);
+
+/// Split same-size candidate groups (indices into `files`) by samples hashed with `algo`.
+/// Each round samples every member of every live group on up to `threads`
+/// workers, then re-splits the groups; files left alone are dropped. Rounds
+/// whose sample would cover the whole file are skipped, since the full digest
+/// reads it anyway. Returns the groups that still need a full digest, in a
+/// deterministic order; files that could not be read are appended to `failed`.
+/// With `cache`, samples it holds are not read, and those read are stored.
+std::vector<std::vector<size_t>> prefilter_groups(const std::vector<FileInfo>& files,
+                                                  std::vector<std::vector<size_t>> groups,
+                                                  const std::vector<PrefilterRound>& rounds,
+                                                  HashAlgo algo, unsigned threads,
+                                                  std::vector<PrefilterRoundStats>& stats,
+                                                  std::vector<size_t>& failed,
+                                                  const SampleCache* cache = nullptr);
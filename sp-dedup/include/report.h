@@ -0,0 +1,176 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "dedup_action.h"
+#include "stats.h"
+
+/// Large output buffer drained by its own thread. Callers append and return;
+/// the thread does the fwrite() calls, so a slow pipe or terminal only holds
+/// up a caller once a second buffer fills while the first is still draining.
+class BufferedWriter {
+public:
+    explicit BufferedWriter(std::FILE* out, size_t capacity = size_t(1) << 20);
+    /// Flushes, then stops the thread.
+    ~BufferedWriter();
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    void write(const char* data, size_t n);
+    void write(const std::string& s) { write(s.data(), s.size()); }
+
+    /// Block until everything written so far has reached the stream.
+    void flush();
+
+private:
+    void hand_off(std::unique_lock<std::mutex>& lock);
+    void run();
+
+    std::FILE* out_;
+    size_t capacity_;
+    std::string fill_, drain_;      // callers append to fill_; the thread writes drain_
+    std::mutex mu_;
+    std::condition_variable work_, idle_;
+    bool draining_ = false, stop_ = false;
+    std::thread thread_;
+};
+
+enum class ReportFormat {
+    Text,       // human-readable blocks (the default)
+    Ndjson,     // one JSON object per line
+};
+
+/// "text" or "ndjson". Returns false for anything else.
+bool parse_report_format(const std::string& name, ReportFormat& out);
+
+/// One path of a duplicate set and what happened to it.
+struct SetMember {
+    enum Role { Keep, Acted, Skipped, Failed } role;
+    std::filesystem::path path;
+    bool same_inode = false;        // another path of an inode listed just before it
+    std::string detail;             // why it was skipped or failed
+};
+
+struct DuplicateSetRecord {
+    std::string ext;
+    std::uint64_t size = 0;
+    const char* algo = nullptr;     // null: members were byte-compared, not hashed
+    std::string digest;             // hex
+    DedupAction action = DedupAction::Delete;
+    std::vector<SetMember> members;
+};
+
+struct SummaryRecord {
+    struct Round { const char* kind; std::uintmax_t bytes; size_t sampled, cached, eliminated; };
+    size_t scanned = 0, skipped_files = 0, linked_paths = 0, hashed = 0, compared = 0;
+    std::uintmax_t skipped_bytes = 0;
+    std::vector<Round> rounds;
+    std::optional<std::pair<size_t, size_t>> cache;     // hits, misses
+    std::optional<size_t> sort_runs;
+    size_t dup_sets = 0, removable = 0, failed_actions = 0;
+    DedupAction action = DedupAction::Delete;
+};
+
+/// --chunk-analysis: bytes of `second` made of chunks first seen in `first`.
+struct ChunkPairRecord {
+    std::filesystem::path first, second;
+    std::uint64_t shared = 0;
+    std::uint64_t second_size = 0;
+};
+
+/// --chunk-analysis totals for the files directly in one directory.
+struct ChunkDirRecord {
+    std::filesystem::path dir;
+    size_t files = 0;
+    std::uint64_t bytes = 0, reclaimable = 0;
+};
+
+struct ChunkSummaryRecord {
+    size_t files = 0;
+    std::uint64_t bytes = 0, chunks = 0;
+    size_t avg_chunk = 0;
+    std::uint64_t reclaimable = 0;          // bytes of chunks seen before
+    std::uint64_t within_files = 0;         // of which repeats inside their own file
+    size_t pairs = 0, pairs_listed = 0;     // file pairs sharing chunks; reported above
+    std::uint64_t unlisted_pair_bytes = 0;  // shared by pairs beyond the pair table's budget
+    std::uint64_t index_bytes = 0, budget = 0;
+    unsigned sample_shift = 0;              // >0: 1 in 2^shift chunks indexed, figures scaled
+};
+
+/// --store: one ingest run. `stored_bytes` is what the new chunks took in the
+/// segments, record headers included.
+struct StoreSummaryRecord {
+    std::filesystem::path store;
+    size_t files = 0, failed = 0;           // recipes written; files without one
+    std::uint64_t bytes = 0, chunks = 0;
+    std::uint64_t new_chunks = 0, new_bytes = 0, stored_bytes = 0;
+    size_t segments = 0;                    // segment files started
+    std::uint64_t wall_ns = 0;
+};
+
+/// `restore`: every recipe of a store written back under `target`.
+struct RestoreSummaryRecord {
+    std::filesystem::path store, target;
+    size_t files = 0, failed = 0;
+    std::uint64_t bytes = 0, wall_ns = 0;
+};
+
+/// Problems with one file that do not stop the run.
+enum class ReportError {
+    Hash,               // could not be hashed
+    Read,               // could not be read for a byte comparison
+    DigestCollision,    // equal digest, different bytes; detail = algorithm
+    CacheRead,          // hash cache ignored
+    CacheWrite,
+    SortRuns,           // path = temp directory
+    StatsWrite,         // --stats-file could not be written
+    StoreOpen,          // path = store directory; detail = why
+    StoreWrite,         // file not recorded in the store; detail = why
+    Restore,            // path = recipe name; detail = why
+    Watch,              // --watch could not start or stopped; path = root; detail = why
+    WatchDir,           // a directory left unwatched; detail = why
+    WatchOverflow,      // inotify events lost; path = root, re-indexed
+};
+
+/// Everything sp_dedup reports goes through one of these. Text keeps the
+/// classic layout with errors on stderr; NDJSON writes every record, errors
+/// included, as one line on the writer. Programs embedding a DedupSession
+/// override the callbacks they care about; the rest do nothing. Calls come
+/// from one thread at a time.
+class Reporter {
+public:
+    virtual ~Reporter() = default;
+
+    /// Paths already sharing one inode (nothing to reclaim).
+    virtual void hard_links(const std::string& /*ext*/, std::uint64_t /*size*/,
+                            const std::vector<std::filesystem::path>& /*paths*/) {}
+    virtual void duplicate_set(const DuplicateSetRecord& /*set*/) {}
+    /// Phase-2 result for one file; `report` is the deduper's own text.
+    virtual void within_file(const std::filesystem::path& /*path*/, const std::string& /*report*/,
+                             bool /*changed*/, bool /*committed*/) {}
+    virtual void error(ReportError /*kind*/, const std::filesystem::path& /*path*/,
+                       const std::string& /*detail*/ = std::string()) {}
+    virtual void summary(const SummaryRecord& /*s*/) {}
+    /// --chunk-analysis results: the top pairs, then every directory, then the totals.
+    virtual void chunk_pair(const ChunkPairRecord& /*pair*/) {}
+    virtual void chunk_dir(const ChunkDirRecord& /*dir*/) {}
+    virtual void chunk_summary(const ChunkSummaryRecord& /*s*/) {}
+    /// --store and `restore` totals.
+    virtual void store_summary(const StoreSummaryRecord& /*s*/) {}
+    virtual void restore_summary(const RestoreSummaryRecord& /*s*/) {}
+    /// --stats: per-stage counters and latency histograms.
+    virtual void stats(const std::vector<StageStats>& /*stages*/) {}
+    /// A one-line status message (dry-run note, section headings, watch state).
+    virtual void notice(const std::string& /*text*/) {}
+    /// Push everything so far to the output (long-running modes, before exit).
+    virtual void flush() {}
+};
+
+std::unique_ptr<Reporter> make_reporter(ReportFormat format, BufferedWriter& out);
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "dedup_action.h"
+#include "file_ops.h"
+#include "hasher.h"
+#include "parallel.h"
+#include "report.h"
+
+/// How a DedupSession finds, confirms and acts on duplicates. The defaults
+/// are the sp_dedup command line's.
+struct ScanOptions {
+    bool recurse = false;
+    std::unordered_set<std::string> only_ext;   // e.g. {".docx",".xlsx",".txt"}; empty = all
+    bool commit = false;        // actually delete / rewrite; otherwise report only
+    DedupAction action = DedupAction::Delete;   // what commit does to Phase-1 duplicates
+    bool verify = true;         // byte-compare digest-matched sets before acting (always for xxh3)
+    size_t prefilter_rounds = 5;            // 0 = hash every size-group member in full
+    std::uintmax_t sample_size = 4096;      // head/tail/middle sample; prefixes grow 16x
+    unsigned threads = default_thread_count();
+    HashAlgo hash = HashAlgo::Sha256;
+    std::filesystem::path cache;            // empty = no persistent hash cache; held in RAM, not for max_memory
+    std::optional<std::uintmax_t> mmap_threshold;   // default: file_reader's crossover
+    bool hugepages = false;
+    std::optional<std::uintmax_t> tree_threshold;   // default: hasher's 1 GiB; 0 = never tree-hash
+    unsigned queue_depth = 32;              // io_uring reads in flight; 0 = blocking reads on the pool
+    size_t compare_max = 2;                 // groups this small are compared, not hashed; <2 = never
+    std::uintmax_t max_memory = 0;          // 0 = whole file table in RAM; else external sort, 2 MiB at least
+    std::filesystem::path temp_dir;         // sort runs; empty = system temp directory
+    size_t chunk_size = 8192;               // analyze_chunks(): average chunk, power of two
+    std::uintmax_t chunk_memory = std::uintmax_t(256) << 20;   // analyze_chunks(): index + pair table
+    int compress_level = 1;                 // ingest(): zlib level for new chunks; 0 = none
+};
+
+/// One deduplication run over a set of directory trees, for embedding the
+/// engine in another program. Configure with ScanOptions, add_root() each
+/// tree, then scan(); everything found is streamed to the Reporter as it is
+/// settled, and with `commit` acted on before the set is reported. Nothing is
+/// written to stdout or stderr. A session is used from one thread at a time;
+/// independent sessions may run concurrently, although the mmap and tree-hash
+/// settings are process-wide.
+///
+///     ScanOptions opt;
+///     opt.recurse = true;
+///     MyReporter sink;                // overrides duplicate_set(), error(), ...
+///     DedupSession s(opt, sink);
+///     if (s.add_root(dir) && s.scan()) use(s.summary());
+class DedupSession {
+public:
+    DedupSession(ScanOptions opt, Reporter& out);
+    ~DedupSession();
+    DedupSession(const DedupSession&) = delete;
+    DedupSession& operator=(const DedupSession&) = delete;
+
+    /// Add a tree to scan. False if `dir` is not a directory, or is inside or
+    /// contains a root already added (its files would be listed twice).
+    bool add_root(const std::filesystem::path& dir);
+
+    /// Phase-1 over every root: list, group, confirm, act and report each
+    /// duplicate set, then report the summary. Roots are listed in the order
+    /// they were added. False if the external sort could not write its runs
+    /// (reported as ReportError::SortRuns); nothing was acted on in that case.
+    bool scan();
+
+    /// Phase-2: rewrite duplicate paragraphs (.docx) and rows (.xlsx) inside
+    /// each scanned file, once per inode. Call after scan().
+    void dedupe_within();
+
+    /// Sub-file duplication across every scanned file, once per inode (see
+    /// chunk_analysis.h): reports the pairs sharing the most chunk bytes, each
+    /// directory's reclaimable bytes and the totals. Reads every file again;
+    /// memory stays within chunk_memory. Call after scan().
+    void analyze_chunks();
+
+    /// Archival instead of scan(): list every root and ingest each file into
+    /// the chunk store in `store` (see chunk_store.h), creating it with `hash`
+    /// and `chunk_size` if needed. Recipes are named by the path below the
+    /// file's root, under the root's own name (or "root<N>") when there are
+    /// several roots. False if the store could not be opened or written
+    /// (reported as ReportError::StoreOpen / StoreWrite).
+    bool ingest(const std::filesystem::path& store);
+
+    /// Totals of the last scan().
+    const SummaryRecord& summary() const;
+
+    /// Every file the last scan() listed, in listing order. Empty with
+    /// max_memory, where the listing is never held in memory.
+    const std::vector<FileInfo>& files() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
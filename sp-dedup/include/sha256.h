@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Portable SHA-256 core used by hasher_portable.cpp. The block function is
+// picked once at startup by CPUID: SHA-NI, then AVX2 (+BMI2), then scalar.
+
+enum class Sha256Backend { Scalar, Avx2, ShaNi };
+
+const char* sha256_backend_name(Sha256Backend b);
+
+/// True if the CPU (and this build) can run backend `b`.
+bool sha256_backend_supported(Sha256Backend b);
+
+/// Backend currently used by sha256_update().
+Sha256Backend sha256_active_backend();
+
+/// Override the dispatched backend (benchmarks). Returns false if unsupported.
+bool sha256_set_backend(Sha256Backend b);
+
+struct Sha256Ctx {
+    std::uint32_t state[8];
+    std::uint64_t total;        // bytes absorbed
+    unsigned char buf[64];
+    size_t buflen;
+};
+
+void sha256_init(Sha256Ctx& c);
+void sha256_update(Sha256Ctx& c, const void* data, size_t len);
+void sha256_final(Sha256Ctx& c, unsigned char out[32]);
+
+// Multi-buffer SHA-256: independent messages hashed side by side, one per
+// 32-bit SIMD lane, for batches of small inputs where a single stream leaves
+// the vector units idle. Serial hashes them one by one with sha256_update().
+
+enum class Sha256ManyBackend { Serial, Avx2x8, Avx512x16 };
+
+const char* sha256_many_backend_name(Sha256ManyBackend b);
+bool sha256_many_backend_supported(Sha256ManyBackend b);
+Sha256ManyBackend sha256_active_many_backend();
+/// Override the dispatched batch backend (benchmarks). Returns false if unsupported.
+bool sha256_set_many_backend(Sha256ManyBackend b);
+
+/// Messages hashed at once by the active batch backend (1, 8 or 16).
+size_t sha256_many_lanes();
+
+/// SHA-256 of `n` messages: out[i] = digest of data[i][0, len[i]).
+void sha256_many(const unsigned char* const* data, const size_t* len, size_t n, unsigned char (*out)[32]);
@@ -0,0 +1,108 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Runtime statistics for --stats / --stats-file: per-stage files, bytes, wall
+// and CPU time, and per-item latency in log2 buckets. Collection is off until
+// stats_enable(); while off, every hook costs one relaxed load.
+
+enum class Stage {
+    Walk,           // directory listing
+    Prefilter,      // sample hashes
+    Hash,           // full-content digests
+    Compare,        // lockstep comparison of small groups
+    Verify,         // lockstep confirmation before acting
+    Action,         // delete / hardlink / reflink
+    Chunk,          // content-defined chunking and chunk digests (--chunk-analysis)
+    Store,          // chunk store ingest, read to recipe (--store)
+    ZipRead,        // inflate one archive entry
+    ZipWrite,       // rebuild an archive with one entry replaced
+    XmlParse,       // docx/xlsx part parse
+    XmlDedupe,      // paragraph/row fingerprinting
+    XmlWrite,       // serialise the edited part
+    Count
+};
+
+const char* stage_name(Stage s);
+
+void stats_enable(bool on);
+bool stats_enabled();
+
+/// Add files and bytes to a stage without a latency sample (e.g. the walk).
+void stats_count(Stage s, std::uint64_t files, std::uint64_t bytes);
+
+/// One item (a file, a group, an archive entry) that took `ns` nanoseconds.
+void stats_item(Stage s, std::uint64_t files, std::uint64_t bytes, std::uint64_t ns);
+
+/// Wall time and process CPU time (every thread) while the span is open. Open
+/// spans on the thread that drives a stage; spans of one stage add up.
+class StageSpan {
+public:
+    explicit StageSpan(Stage s);
+    ~StageSpan();
+    StageSpan(const StageSpan&) = delete;
+    StageSpan& operator=(const StageSpan&) = delete;
+
+private:
+    Stage stage_;
+    bool on_;
+    std::chrono::steady_clock::time_point t0_;
+    std::uint64_t cpu0_ = 0;
+};
+
+/// Latency of one item, recorded with its files and bytes on destruction.
+class StageItem {
+public:
+    explicit StageItem(Stage s, std::uint64_t files = 1, std::uint64_t bytes = 0)
+        : stage_(s), files_(files), bytes_(bytes), on_(stats_enabled()) {
+        if (on_) t0_ = std::chrono::steady_clock::now();
+    }
+    ~StageItem();
+    StageItem(const StageItem&) = delete;
+    StageItem& operator=(const StageItem&) = delete;
+
+    void bytes(std::uint64_t n) { bytes_ = n; }
+
+private:
+    Stage stage_;
+    std::uint64_t files_, bytes_;
+    bool on_;
+    std::chrono::steady_clock::time_point t0_;
+};
+
+/// A single-threaded step that is both a span and an item (archive and XML work, actions).
+class StageTimer {
+public:
+    explicit StageTimer(Stage s, std::uint64_t bytes = 0) : span_(s), item_(s, 1, bytes) {}
+    void bytes(std::uint64_t n) { item_.bytes(n); }
+
+private:
+    StageSpan span_;    // destroyed after item_, so the span covers the whole item
+    StageItem item_;
+};
+
+/// Bucket b counts latencies in [2^(b-1), 2^b) ns; bucket 0 counts zero.
+constexpr size_t kLatencyBuckets = 64;
+
+struct StageStats {
+    Stage stage;
+    std::uint64_t files = 0, bytes = 0;
+    std::uint64_t wall_ns = 0, cpu_ns = 0;
+    std::uint64_t items = 0, latency_ns = 0;        // latency sum over items
+    std::array<std::uint64_t, kLatencyBuckets> hist{};
+};
+
+/// Stages that handled any files or items, in Stage order.
+std::vector<StageStats> stats_snapshot();
+
+/// Upper bound of the latency bucket holding the q-quantile (0 if no items).
+std::uint64_t stats_quantile_ns(const StageStats& s, double q);
+
+/// Write `stages` in the Prometheus text exposition format for node_exporter's
+/// textfile collector. Written to a temp name and renamed, so the collector
+/// never reads a partial file. False on an I/O error.
+bool write_prometheus_textfile(const std::filesystem::path& p, const std::vector<StageStats>& stages);
@@ -0,0 +1,30 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "dedup_action.h"
+#include "file_ops.h"
+#include "hasher.h"
+#include "report.h"
+
+struct WatchOptions {
+    std::filesystem::path root;
+    bool recurse = false;
+    std::unordered_set<std::string> only_ext;   // empty = every extension
+    HashAlgo hash = HashAlgo::Sha256;
+    bool commit = false;
+    DedupAction action = DedupAction::Delete;
+    bool verify = true;                         // byte-compare before acting (always for xxh3)
+    unsigned debounce_ms = 2000;                // quiet time after the last event on a path
+};
+
+/// Keep running after the initial scan: index `initial` by (extension, size),
+/// then follow inotify events under `root`. A created or rewritten file is
+/// hashed once it has been quiet for `debounce_ms`, and compared only against
+/// indexed files of its extension and size, whose digests are computed lazily
+/// and kept. A match is reported to `out` as a duplicate set with the existing
+/// file as KEEP and, with `commit`, acted on; each set is flushed as it
+/// happens. Blocks in poll() while nothing is pending. Returns the process
+/// exit code when interrupted (SIGINT/SIGTERM); not supported outside Linux.
+int watch_tree(const WatchOptions& opt, const std::vector<FileInfo>& initial, Reporter& out);
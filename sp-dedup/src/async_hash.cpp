@@ -0,0 +1,465 @@
+#include "async_hash.h"
+#include "file_reader.h"
+#include "parallel.h"
+#include "stats.h"
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Blocking hash_file() of one path, timed under Stage::Hash.
+    std::optional<Digest> hash_one(const std::filesystem::path& p, HashAlgo algo) {
+        StageItem item(Stage::Hash);
+        if (stats_enabled()) {
+            std::error_code ec;
+            auto n = std::filesystem::file_size(p, ec);
+            if (!ec) item.bytes(n);
+        }
+        try { return hash_file(p, algo); } catch (...) { return std::nullopt; }
+    }
+
+    // SHA-256 files up to kBatchMaxSize are read whole, kBatchFiles at a time
+    // per worker, into one reused arena and digested together by sha256_batch().
+    const std::uintmax_t kBatchMaxSize = std::uintmax_t(64) << 10;
+    const size_t kBatchFiles = 64;
+
+    void hash_small_batched(const std::vector<std::filesystem::path>& paths, const std::vector<std::uintmax_t>& sizes,
+                            const std::vector<size_t>& small, unsigned threads,
+                            std::vector<std::optional<Digest>>& out) {
+        size_t batches = (small.size() + kBatchFiles - 1) / kBatchFiles;
+        parallel_for(batches, threads, [&](size_t b) {
+            thread_local std::string arena;         // warm pages across batches
+            size_t first = b * kBatchFiles, last = std::min(small.size(), first + kBatchFiles);
+            std::vector<size_t> read, start;        // file index and arena offset of each buffer
+            std::vector<std::uint64_t> readNs;
+            arena.clear();
+            for (size_t k = first; k < last; ++k) {
+                auto t0 = std::chrono::steady_clock::now();
+                size_t at = arena.size();
+                arena.reserve(at + (size_t)sizes[small[k]]);
+                try {
+                    read_file_range(paths[small[k]], 0, UINTMAX_MAX, [&](const void* d, size_t n) {
+                        arena.append(static_cast<const char*>(d), n);
+                    });
+                } catch (...) {
+                    arena.resize(at);   // unreadable: nullopt
+                    continue;
+                }
+                read.push_back(small[k]);
+                start.push_back(at);
+                readNs.push_back((std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - t0).count());
+            }
+            start.push_back(arena.size());
+            std::vector<const void*> data(read.size());
+            std::vector<size_t> len(read.size());
+            for (size_t j = 0; j < read.size(); ++j) {
+                data[j] = arena.data() + start[j];
+                len[j] = start[j + 1] - start[j];
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            std::vector<Digest> digests(read.size());
+            sha256_batch(data.data(), len.data(), read.size(), digests.data());
+            auto hashNs = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - t0).count();
+            for (size_t j = 0; j < read.size(); ++j) {
+                out[read[j]] = digests[j];
+                // each file's own read plus its share of the batch digest
+                stats_item(Stage::Hash, 1, len[j], readNs[j] + hashNs / read.size());
+            }
+        });
+    }
+
+    std::vector<std::optional<Digest>> hash_files_pool(const std::vector<std::filesystem::path>& paths,
+                                                       HashAlgo algo, unsigned threads) {
+        std::vector<std::optional<Digest>> out(paths.size());
+        parallel_for(paths.size(), threads, [&](size_t i) { out[i] = hash_one(paths[i], algo); });
+        return out;
+    }
+}
+
+#ifdef __linux__
+
+namespace {
+    const size_t kBlock = 1 << 18;                // per-slot registered buffer
+    const std::uint64_t kWakeup = ~std::uint64_t(0);
+
+    int sys_setup(unsigned entries, io_uring_params* p) {
+        return (int)::syscall(__NR_io_uring_setup, entries, p);
+    }
+    int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+        return (int)::syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+    }
+    int sys_register(int fd, unsigned op, const void* arg, unsigned n) {
+        return (int)::syscall(__NR_io_uring_register, fd, op, arg, n);
+    }
+
+    // Minimal raw io_uring: one submitter at a time (guarded by the caller's
+    // mutex), one reaper thread.
+    class Ring {
+    public:
+        bool init(unsigned entries) {
+            io_uring_params p{};
+            fd_ = sys_setup(entries, &p);
+            if (fd_ < 0) return false;
+            sqLen_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cqLen_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            if (p.features & IORING_FEAT_SINGLE_MMAP) sqLen_ = cqLen_ = std::max(sqLen_, cqLen_);
+            sq_ = ::mmap(nullptr, sqLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+            if (sq_ == MAP_FAILED) { sq_ = nullptr; return false; }
+            if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                cq_ = sq_;
+            } else {
+                cq_ = ::mmap(nullptr, cqLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+                if (cq_ == MAP_FAILED) { cq_ = nullptr; return false; }
+            }
+            sqesLen_ = p.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = (io_uring_sqe*)::mmap(nullptr, sqesLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+            if (sqes_ == MAP_FAILED) { sqes_ = nullptr; return false; }
+
+            auto sq = (char*)sq_; auto cq = (char*)cq_;
+            sqTail_ = (unsigned*)(sq + p.sq_off.tail);
+            sqMask_ = *(unsigned*)(sq + p.sq_off.ring_mask);
+            sqArray_ = (unsigned*)(sq + p.sq_off.array);
+            cqHead_ = (unsigned*)(cq + p.cq_off.head);
+            cqTail_ = (unsigned*)(cq + p.cq_off.tail);
+            cqMask_ = *(unsigned*)(cq + p.cq_off.ring_mask);
+            cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+            return true;
+        }
+
+        ~Ring() {
+            if (sqes_) ::munmap(sqes_, sqesLen_);
+            if (cq_ && cq_ != sq_) ::munmap(cq_, cqLen_);
+            if (sq_) ::munmap(sq_, sqLen_);
+            if (fd_ >= 0) ::close(fd_);
+        }
+
+        bool register_buffers(const std::vector<iovec>& iov) {
+            return sys_register(fd_, IORING_REGISTER_BUFFERS, iov.data(), (unsigned)iov.size()) == 0;
+        }
+
+        // Caller holds the submit lock.
+        bool submit(const io_uring_sqe& e) {
+            unsigned tail = *sqTail_;
+            unsigned idx = tail & sqMask_;
+            sqes_[idx] = e;
+            sqArray_[idx] = idx;
+            __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+            for (;;) {
+                int r = sys_enter(fd_, 1, 0, 0);
+                if (r >= 0) return true;
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+            }
+        }
+
+        // Block until at least one completion, then hand each to `fn`.
+        template <class Fn> bool reap(Fn&& fn) {
+            unsigned head = *cqHead_;
+            if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+                if (sys_enter(fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) return false;
+            }
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe& c = cqes_[head & cqMask_];
+                fn(c.user_data, c.res);
+            }
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+            return true;
+        }
+
+    private:
+        int fd_ = -1;
+        void* sq_ = nullptr; void* cq_ = nullptr;
+        size_t sqLen_ = 0, cqLen_ = 0, sqesLen_ = 0;
+        io_uring_sqe* sqes_ = nullptr;
+        unsigned* sqTail_ = nullptr; unsigned* sqArray_ = nullptr; unsigned sqMask_ = 0;
+        unsigned* cqHead_ = nullptr; unsigned* cqTail_ = nullptr; unsigned cqMask_ = 0;
+        io_uring_cqe* cqes_ = nullptr;
+    };
+
+    // One slot per in-flight read: a registered buffer and the file it is reading.
+    struct Slot {
+        size_t file = 0;
+        int fd = -1;
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;     // from fstat; reads stop here
+        std::unique_ptr<HashState> state;
+        std::chrono::steady_clock::time_point opened;   // --stats latency
+        ~Slot() { if (fd >= 0) ::close(fd); }
+    };
+
+    class Engine {
+    public:
+        Engine(const std::vector<std::filesystem::path>& paths, HashAlgo algo, unsigned threads, unsigned qd)
+            : paths_(paths), algo_(algo), threads_(std::max(1u, threads)), qd_(qd),
+              out_(paths.size()), slots_(qd), buffers_(size_t(qd) * kBlock) {}
+
+        bool init() {
+            if (!ring_.init(qd_ + 1)) return false;   // +1 for the wake-up NOP
+            std::vector<iovec> iov(qd_);
+            for (unsigned i = 0; i < qd_; ++i) iov[i] = {buffers_.data() + size_t(i) * kBlock, kBlock};
+            return ring_.register_buffers(iov);
+        }
+
+        std::vector<std::optional<Digest>> run() {
+            for (unsigned s = 0; s < qd_; ++s) start_next(s);
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads_; ++t) workers.emplace_back([this] { work(); });
+
+            // This thread reaps completions and queues them for the workers.
+            while (done_ < paths_.size()) {
+                bool ok = ring_.reap([&](std::uint64_t slot, int res) {
+                    // Pair with the submitter's unlock so the slot state it wrote
+                    // before submitting is visible to whichever worker gets this
+                    // completion (the kernel round-trip is invisible to TSAN).
+                    { std::lock_guard<std::mutex> sync(smu_); }
+                    if (slot == kWakeup) return;
+                    std::lock_guard<std::mutex> lk(qmu_);
+                    queue_.push_back({(unsigned)slot, res});
+                    qcv_.notify_one();
+                });
+                if (!ok) {
+                    broken_ = true;
+                    break;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lk(qmu_);
+                closing_ = true;
+            }
+            qcv_.notify_all();
+            for (auto& w : workers) w.join();
+            if (broken_) recover();
+            return std::move(out_);
+        }
+
+    private:
+        struct Completion { unsigned slot; int res; };
+
+        // The ring could not be reaped: completions of reads still in flight
+        // will never arrive. Their files, and those never started, are hashed
+        // with blocking reads. The registered buffers stay pinned until the
+        // ring is closed, so late kernel writes land nowhere that matters.
+        void recover() {
+            std::vector<size_t> left;
+            for (auto& s : slots_) {
+                if (s.fd < 0) continue;
+                ::close(s.fd);
+                s.fd = -1;
+                s.state.reset();
+                left.push_back(s.file);
+            }
+            for (size_t i = next_; i < paths_.size(); ++i) left.push_back(i);
+            next_ = paths_.size();
+            parallel_for(left.size(), threads_, [&](size_t k) { out_[left[k]] = hash_one(paths_[left[k]], algo_); });
+        }
+
+        void work() {
+            for (;;) {
+                Completion c;
+                {
+                    std::unique_lock<std::mutex> lk(qmu_);
+                    qcv_.wait(lk, [&] { return closing_ || !queue_.empty(); });
+                    if (queue_.empty()) return;
+                    c = queue_.front();
+                    queue_.pop_front();
+                }
+                Slot& s = slots_[c.slot];
+                if (c.res < 0) { finish(c.slot, false); continue; }
+                if (c.res > 0) {
+                    s.state->update(buffers_.data() + size_t(c.slot) * kBlock, (size_t)c.res);
+                    s.offset += (std::uint64_t)c.res;
+                }
+                if (c.res == 0) finish(c.slot, false);   // shrank below its fstat() size
+                else if (s.offset >= s.size) finish(c.slot, true);
+                else if (!submit_read(c.slot)) fallback(c.slot);
+            }
+        }
+
+        void finish(unsigned slot, bool ok) {
+            Slot& s = slots_[slot];
+            if (ok) {
+                try { out_[s.file] = s.state->finish(); } catch (...) {}
+                if (stats_enabled()) {
+                    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - s.opened).count();
+                    stats_item(Stage::Hash, 1, s.offset, (std::uint64_t)ns);
+                }
+            }
+            ::close(s.fd);
+            s.fd = -1;
+            s.state.reset();
+            file_done();
+            start_next(slot);
+        }
+
+        // The ring refused a submission: finish this file with blocking reads.
+        void fallback(unsigned slot) {
+            Slot& s = slots_[slot];
+            ::close(s.fd);
+            s.fd = -1;
+            s.state.reset();
+            out_[s.file] = hash_one(paths_[s.file], algo_);
+            file_done();
+            start_next(slot);
+        }
+
+        void file_done() {
+            if (++done_ == paths_.size()) {
+                // the reaper may be blocked with nothing in flight
+                io_uring_sqe e{};
+                e.opcode = IORING_OP_NOP;
+                e.user_data = kWakeup;
+                std::lock_guard<std::mutex> lk(smu_);
+                ring_.submit(e);
+            }
+        }
+
+        // Open the next unclaimed file on `slot` and issue its first read.
+        void start_next(unsigned slot) {
+            for (;;) {
+                if (broken_) return;            // recover() takes the rest
+                size_t i = next_++;
+                if (i >= paths_.size()) return;
+                Slot& s = slots_[slot];
+                s.file = i;
+                s.offset = 0;
+                if (stats_enabled()) s.opened = std::chrono::steady_clock::now();
+                s.fd = ::open(paths_[i].c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat st{};
+                if (s.fd < 0 || ::fstat(s.fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+                    uses_tree_digest((std::uintmax_t)st.st_size)) {
+                    // special, unreadable or tree-mode: leave it to the blocking path
+                    if (s.fd >= 0) ::close(s.fd);
+                    s.fd = -1;
+                    out_[i] = hash_one(paths_[i], algo_);
+                    file_done();
+                    continue;
+                }
+                s.size = (std::uint64_t)st.st_size;
+                try { s.state.reset(new HashState(algo_)); } catch (...) { ::close(s.fd); s.fd = -1; file_done(); continue; }
+                if (s.size == 0) {
+                    out_[i] = s.state->finish();
+                    ::close(s.fd); s.fd = -1; s.state.reset();
+                    file_done();
+                    continue;
+                }
+                if (submit_read(slot)) return;
+                ::close(s.fd); s.fd = -1; s.state.reset();
+                out_[i] = hash_one(paths_[i], algo_);
+                file_done();
+            }
+        }
+
+        bool submit_read(unsigned slot) {
+            if (broken_) return false;
+            Slot& s = slots_[slot];
+            io_uring_sqe e{};
+            e.opcode = IORING_OP_READ_FIXED;
+            e.fd = s.fd;
+            e.off = s.offset;
+            e.addr = (std::uint64_t)(uintptr_t)(buffers_.data() + size_t(slot) * kBlock);
+            e.len = (unsigned)std::min<std::uint64_t>(kBlock, s.size - s.offset);
+            e.buf_index = (std::uint16_t)slot;
+            e.user_data = slot;
+            std::lock_guard<std::mutex> lk(smu_);
+            return ring_.submit(e);
+        }
+
+        const std::vector<std::filesystem::path>& paths_;
+        HashAlgo algo_;
+        unsigned threads_, qd_;
+        std::vector<std::optional<Digest>> out_;
+        std::vector<Slot> slots_;
+        std::vector<char> buffers_;
+        Ring ring_;
+
+        std::atomic<size_t> next_{0}, done_{0};
+        std::atomic<bool> broken_{false};       // reaping failed; no new reads
+        std::mutex smu_;                        // serialises SQ writers
+        std::mutex qmu_;
+        std::condition_variable qcv_;
+        std::deque<Completion> queue_;
+        bool closing_ = false;
+    };
+}
+
+bool io_uring_available() {
+    io_uring_params p{};
+    int fd = sys_setup(1, &p);
+    if (fd < 0) return false;
+    ::close(fd);
+    return true;
+}
+
+std::vector<std::optional<Digest>> hash_files(const std::vector<std::filesystem::path>& paths,
+                                              HashAlgo algo, unsigned threads, unsigned queue_depth) {
+    if (queue_depth == 0 || paths.empty()) return hash_files_pool(paths, algo, threads);
+    unsigned qd = (unsigned)std::min<size_t>(queue_depth, paths.size());
+    qd = std::min(qd, 1024u);
+    Engine e(paths, algo, threads, qd);
+    if (!e.init()) return hash_files_pool(paths, algo, threads);
+    return e.run();
+}
+
+#else
+
+bool io_uring_available() { return false; }
+
+std::vector<std::optional<Digest>> hash_files(const std::vector<std::filesystem::path>& paths,
+                                              HashAlgo algo, unsigned threads, unsigned) {
+    return hash_files_pool(paths, algo, threads);
+}
+
+#endif
+
+std::vector<std::optional<Digest>> hash_files(const std::vector<std::filesystem::path>& paths,
+                                              const std::vector<std::uintmax_t>& sizes,
+                                              HashAlgo algo, unsigned threads, unsigned queue_depth) {
+    const bool batch = algo == HashAlgo::Sha256 && sha256_batch_lanes() >= 2;
+    std::vector<size_t> tree, small, large;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (uses_tree_digest(sizes[i])) tree.push_back(i);
+        else if (batch && sizes[i] <= kBatchMaxSize) small.push_back(i);
+        else large.push_back(i);
+    }
+    if (tree.empty() && small.size() < 2) return hash_files(paths, algo, threads, queue_depth);
+    if (small.size() < 2) {
+        large.insert(large.end(), small.begin(), small.end());
+        std::sort(large.begin(), large.end());
+        small.clear();
+    }
+
+    std::vector<std::optional<Digest>> out(paths.size());
+    // Tree-mode files one at a time, each over every worker.
+    for (size_t i : tree) {
+        StageItem item(Stage::Hash, 1, sizes[i]);
+        try { out[i] = hash_file_tree(paths[i], algo, threads); } catch (...) {}
+    }
+    if (!large.empty()) {
+        std::vector<std::filesystem::path> rest;
+        for (size_t i : large) rest.push_back(paths[i]);
+        auto digests = hash_files(rest, algo, threads, queue_depth);
+        for (size_t k = 0; k < large.size(); ++k) out[large[k]] = std::move(digests[k]);
+    }
+    if (!small.empty()) hash_small_batched(paths, sizes, small, threads, out);
+    return out;
+}
@@ -0,0 +1,219 @@
+#include "chunk_analysis.h"
+#include "chunker.h"
+#include "file_reader.h"
+#include "stats.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace {
+    const std::uint32_t kFree = ~std::uint32_t(0);      // empty slot / "chunk was new"
+    const std::uint32_t kSkipped = kFree - 1;           // outside the sample
+    const size_t kPairNodeBytes = 48;                   // unordered_map node + bucket, roughly
+    const size_t kListedPairs = 50;
+
+    /// 128 bits of a chunk digest and the file it was first seen in.
+    struct Entry {
+        std::uint64_t k0, k1;
+        std::uint32_t file;
+    };
+
+    struct DirTotals {
+        size_t files = 0;
+        std::uint64_t bytes = 0, reclaimable = 0;
+    };
+}
+
+struct ChunkAnalysis::Impl {
+    HashAlgo algo;
+    Chunker chunker;
+    std::uintmax_t budget;
+
+    // Open addressing, linear probing; slot = k0 & mask.
+    std::vector<Entry> table;
+    size_t mask = 0, used = 0, maxSlots = 0;
+    unsigned shift = 0;                 // sample: digests whose top `shift` bits of k1 are 0
+
+    std::unordered_map<std::uint64_t, std::uint64_t> pairs;    // first << 32 | second -> bytes
+    size_t pairCap = 0;
+    std::uint64_t unlistedPairBytes = 0;
+    std::map<fs::path, DirTotals> dirs;
+
+    ChunkSummaryRecord sum;
+    std::unordered_map<std::uint32_t, std::uint64_t> shared;   // this file's bytes per earlier file
+
+    Impl(HashAlgo a, size_t avg, std::uintmax_t b) : algo(a), chunker(avg), budget(b) {}
+
+    bool sampled(std::uint64_t k1) const { return shift == 0 || (k1 >> (64 - shift)) == 0; }
+
+    // Backward-shift deletion: pull later members of the probe run into the hole.
+    void erase(size_t hole) {
+        for (size_t j = hole;;) {
+            j = (j + 1) & mask;
+            const Entry& e = table[j];
+            if (e.file == kFree) break;
+            size_t home = e.k0 & mask;
+            bool stays = hole <= j ? (hole < home && home <= j) : (hole < home || home <= j);
+            if (stays) continue;
+            table[hole] = e;
+            hole = j;
+        }
+        table[hole].file = kFree;
+        --used;
+    }
+
+    void grow() {
+        std::vector<Entry> old(table.size() * 2, Entry{0, 0, kFree});
+        old.swap(table);
+        mask = table.size() - 1;
+        for (auto& e : old) {
+            if (e.file == kFree) continue;
+            size_t i = e.k0 & mask;
+            while (table[i].file != kFree) i = (i + 1) & mask;
+            table[i] = e;
+        }
+    }
+
+    // Halve the sample and drop the entries that left it.
+    void raise_sampling() {
+        ++shift;
+        for (size_t i = 0; i < table.size();) {
+            if (table[i].file != kFree && !sampled(table[i].k1)) erase(i);   // slot i refilled: look again
+            else ++i;
+        }
+    }
+
+    // The file that first had this chunk; kFree after indexing it for `file`;
+    // kSkipped if it falls outside the sample.
+    std::uint32_t find_or_add(std::uint64_t k0, std::uint64_t k1, std::uint32_t file) {
+        for (;;) {
+            if (!sampled(k1)) return kSkipped;
+            size_t i = k0 & mask;
+            for (; table[i].file != kFree; i = (i + 1) & mask) {
+                if (table[i].k0 == k0 && table[i].k1 == k1) return table[i].file;
+            }
+            if ((used + 1) * 4 > table.size() * 3) {
+                if (table.size() < maxSlots) grow();
+                else raise_sampling();
+                continue;
+            }
+            table[i] = {k0, k1, file};
+            ++used;
+            return kFree;
+        }
+    }
+};
+
+ChunkAnalysis::ChunkAnalysis(HashAlgo algo, size_t avg_chunk, std::uintmax_t memory_budget)
+    : impl_(new Impl(algo, avg_chunk, memory_budget)) {
+    Impl& s = *impl_;
+    // An eighth of the budget for the pair table, the rest for the index.
+    std::uintmax_t pairBytes = memory_budget / 8;
+    s.pairCap = std::max<size_t>(1, (size_t)(pairBytes / kPairNodeBytes));
+    // The index doubles as it fills; at its largest, the old and new tables
+    // must fit together.
+    s.maxSlots = 1024;
+    while ((std::uintmax_t)s.maxSlots * 3 * sizeof(Entry) <= memory_budget - pairBytes) s.maxSlots *= 2;
+    s.table.assign(std::min<size_t>(s.maxSlots, 1 << 16), Entry{0, 0, kFree});
+    s.mask = s.table.size() - 1;
+    s.sum.avg_chunk = avg_chunk;
+    s.sum.budget = memory_budget;
+}
+
+ChunkAnalysis::~ChunkAnalysis() = default;
+
+bool ChunkAnalysis::add_file(std::uint32_t id, const fs::path& p) {
+    Impl& s = *impl_;
+    StageItem item(Stage::Chunk);
+    std::uint64_t bytes = 0, chunks = 0, reclaimable = 0, within = 0;
+    s.shared.clear();
+    auto sink = [&](const unsigned char* data, size_t n) {
+        ++chunks;
+        bytes += n;
+        Digest d = hash_bytes(s.algo, data, n);
+        std::uint64_t k0, k1;
+        std::memcpy(&k0, d.data(), 8);
+        std::memcpy(&k1, d.data() + 8, 8);
+        std::uint32_t first = s.find_or_add(k0, k1, id);
+        if (first == kFree || first == kSkipped) return;
+        std::uint64_t w = std::uint64_t(n) << s.shift;
+        reclaimable += w;
+        if (first == id) within += w;
+        else s.shared[first] += w;
+    };
+    try {
+        read_file_range(p, 0, UINTMAX_MAX, [&](const void* d, size_t n) { s.chunker.update(d, n, sink); });
+        s.chunker.finish(sink);
+    } catch (...) {
+        s.chunker.finish([](const unsigned char*, size_t) {});
+        return false;
+    }
+    item.bytes(bytes);
+
+    ++s.sum.files;
+    s.sum.bytes += bytes;
+    s.sum.chunks += chunks;
+    s.sum.reclaimable += reclaimable;
+    s.sum.within_files += within;
+    auto& dir = s.dirs[p.parent_path()];
+    ++dir.files;
+    dir.bytes += bytes;
+    dir.reclaimable += reclaimable;
+    for (auto& [first, n] : s.shared) {
+        std::uint64_t key = (std::uint64_t(first) << 32) | id;
+        if (s.pairs.size() < s.pairCap) s.pairs.emplace(key, n);
+        else s.unlistedPairBytes += n;
+    }
+    return true;
+}
+
+namespace {
+    // Largest first; ties in file order.
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> top_pairs(
+            const std::unordered_map<std::uint64_t, std::uint64_t>& pairs) {
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> v(pairs.begin(), pairs.end());
+        size_t n = std::min(v.size(), kListedPairs);
+        std::partial_sort(v.begin(), v.begin() + n, v.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        v.resize(n);
+        return v;
+    }
+}
+
+std::vector<std::uint32_t> ChunkAnalysis::reported_files() const {
+    std::vector<std::uint32_t> ids;
+    for (auto& [key, n] : top_pairs(impl_->pairs)) {
+        ids.push_back((std::uint32_t)(key >> 32));
+        ids.push_back((std::uint32_t)key);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void ChunkAnalysis::report(Reporter& out, const std::unordered_map<std::uint32_t, FileInfo>& files) const {
+    const Impl& s = *impl_;
+    auto top = top_pairs(s.pairs);
+    for (auto& [key, n] : top) {
+        auto a = files.find((std::uint32_t)(key >> 32)), b = files.find((std::uint32_t)key);
+        if (a == files.end() || b == files.end()) continue;
+        ChunkPairRecord rec;
+        rec.first = a->second.path;
+        rec.second = b->second.path;
+        rec.shared = n;
+        rec.second_size = b->second.size;
+        out.chunk_pair(rec);
+    }
+    for (auto& [dir, t] : s.dirs) out.chunk_dir({dir, t.files, t.bytes, t.reclaimable});
+
+    ChunkSummaryRecord sum = s.sum;
+    sum.pairs = s.pairs.size();
+    sum.pairs_listed = top.size();
+    sum.unlisted_pair_bytes = s.unlistedPairBytes;
+    sum.index_bytes = s.table.size() * sizeof(Entry) + s.pairs.size() * kPairNodeBytes;
+    sum.sample_shift = s.shift;
+    out.chunk_summary(sum);
+}
@@ -0,0 +1,658 @@
+#include "chunk_store.h"
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "chunker.h"
+#include "file_reader.h"
+#include "stats.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    const int kFormat = 1;
+    const char kSegmentMagic[8] = {'S','P','D','S','E','G','0','1'};
+    const char kIndexMagic[8] = {'S','P','D','I','N','D','0','1'};
+    const char kRecipeMagic[8] = {'S','P','D','R','C','P','0','1'};
+    const std::uint64_t kSegmentBytes = std::uint64_t(256) << 20;
+    const size_t kBatchBytes = size_t(4) << 20;     // chunk bytes handed to a worker at a time
+    const size_t kRecordHeader = 4 + 4 + 1 + sizeof(Digest);
+    const size_t kGiveUp = 8, kProbe = 16;          // compression backoff within a batch
+    const size_t kCommitBatches = 64;               // commit at least every 256 MiB read...
+    const auto kCommitInterval = std::chrono::seconds(5);      // ...or every 5 seconds
+
+    enum Codec : std::uint8_t { Raw = 0, Deflate = 1 };
+
+    template <class T> void put(std::ostream& o, T v) { o.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    template <class T> bool get(std::istream& i, T& v) { return (bool)i.read(reinterpret_cast<char*>(&v), sizeof(v)); }
+
+    /// Where a chunk's record lives; `offset` is that of its bytes.
+    struct Location {
+        std::uint32_t segment = 0;
+        std::uint64_t offset = 0;
+        std::uint32_t stored = 0, raw = 0;
+        std::uint8_t codec = Raw;
+    };
+
+    struct RecipeEntry {
+        Digest digest;
+        std::uint32_t len;
+    };
+
+    fs::path segment_path(const fs::path& dir, std::uint32_t n) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%08u.seg", (unsigned)n);
+        return dir / "segments" / name;
+    }
+
+    // Force a file's data, or a directory's entries, to disk. Windows has no
+    // directory flush; NTFS journals the entries itself.
+    bool sync_path(const fs::path& p, bool dir = false) {
+#ifdef _WIN32
+        if (dir) return true;
+        HANDLE h = CreateFileW(p.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (h == INVALID_HANDLE_VALUE) return false;
+        bool ok = FlushFileBuffers(h) != 0;
+        CloseHandle(h);
+        return ok;
+#else
+        int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC | (dir ? O_DIRECTORY : 0));
+        if (fd < 0) return false;
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+#endif
+    }
+
+    // sync_path() for many small files: on Linux one syncfs() of the
+    // filesystem holding them is far cheaper than an fsync() each.
+    bool sync_files(const fs::path& dir, const std::vector<fs::path>& files) {
+#ifdef __linux__
+        int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECTORY);
+        if (fd >= 0) {
+            bool ok = ::syncfs(fd) == 0;
+            ::close(fd);
+            if (ok) return true;
+        }
+#endif
+        (void)dir;
+        for (auto& f : files) if (!sync_path(f)) return false;
+        return true;
+    }
+
+    // One reader batch: whole chunks back to back, and where files end in it.
+    struct Batch {
+        struct Chunk {
+            size_t off;
+            std::uint32_t len;
+            Digest digest;
+            bool fresh = false;             // first time this chunk is stored
+            size_t packedOff = 0;
+            std::uint32_t packedLen = 0;
+            std::uint8_t codec = Raw;
+        };
+        struct FileEnd {
+            size_t chunks;                  // the file ends after this many of the batch's chunks
+            std::uint32_t file;
+            std::uint64_t bytes;
+            std::int64_t mtime;
+            std::string error;              // empty: read in full
+        };
+        size_t seq = 0;
+        std::vector<unsigned char> data, packed;
+        std::vector<Chunk> chunks;
+        std::vector<FileEnd> ends;
+    };
+
+    struct Problem {
+        ReportError kind;
+        fs::path path;
+        std::string detail;
+    };
+}
+
+struct ChunkStore::Impl {
+    fs::path dir;
+    ChunkStoreOptions opt;
+    std::unordered_map<Digest, Location, DigestHash> index;
+    std::uint32_t nextSegment = 1;
+
+    void create();
+    void load();
+    void restore_file(const fs::path& name, const fs::path& target, std::uint64_t& bytes) const;
+};
+
+// store.cfg, an empty index and the directories.
+void ChunkStore::Impl::create() {
+    if (!hash_algo_is_cryptographic(opt.hash)) {
+        throw std::runtime_error(std::string("a chunk store needs a cryptographic digest, not ") + hash_algo_name(opt.hash));
+    }
+    for (auto sub : {"segments", "recipes", "tmp"}) fs::create_directories(dir / sub);
+    {
+        std::ofstream cfg(dir / "store.cfg", std::ios::trunc);
+        cfg << "sp-dedup chunk store\nformat=" << kFormat << "\nhash=" << hash_algo_name(opt.hash)
+            << "\nchunk_size=" << opt.chunk_size << "\n";
+        if (!cfg) throw std::runtime_error("cannot write store.cfg");
+    }
+    std::ofstream idx(dir / "index", std::ios::binary | std::ios::trunc);
+    idx.write(kIndexMagic, sizeof(kIndexMagic));
+    if (!idx) throw std::runtime_error("cannot write the index");
+}
+
+// Settings from store.cfg, then every index record whose bytes made it into
+// their segment (an interrupted run may have left records past the end).
+void ChunkStore::Impl::load() {
+    std::ifstream cfg(dir / "store.cfg");
+    std::string line;
+    if (!std::getline(cfg, line) || line != "sp-dedup chunk store") throw std::runtime_error("not a chunk store");
+    int format = 0;
+    while (std::getline(cfg, line)) {
+        auto eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        auto key = line.substr(0, eq), value = line.substr(eq + 1);
+        if (key == "format") format = std::atoi(value.c_str());
+        else if (key == "hash" && !parse_hash_algo(value, opt.hash)) throw std::runtime_error("unknown digest " + value);
+        else if (key == "chunk_size") opt.chunk_size = (size_t)std::strtoull(value.c_str(), nullptr, 10);
+    }
+    if (format != kFormat) throw std::runtime_error("unsupported store format " + std::to_string(format));
+    if (opt.chunk_size < 256 || opt.chunk_size > (1u << 20) || (opt.chunk_size & (opt.chunk_size - 1))) {
+        throw std::runtime_error("bad chunk_size in store.cfg");
+    }
+
+    std::map<std::uint32_t, std::uint64_t> segmentBytes;
+    std::error_code ec;
+    for (auto& e : fs::directory_iterator(dir / "segments", ec)) {
+        std::uint32_t n = (std::uint32_t)std::strtoul(e.path().stem().string().c_str(), nullptr, 10);
+        if (e.path().extension() != ".seg" || !n) continue;
+        segmentBytes[n] = e.file_size(ec);
+        nextSegment = std::max(nextSegment, n + 1);
+    }
+    if (ec) throw std::runtime_error("cannot list segments: " + ec.message());
+
+    std::ifstream idx(dir / "index", std::ios::binary);
+    char magic[sizeof(kIndexMagic)];
+    if (!idx.read(magic, sizeof(magic)) || std::memcmp(magic, kIndexMagic, sizeof(magic)) != 0) {
+        throw std::runtime_error("unreadable index");
+    }
+    for (;;) {
+        Digest d;
+        Location loc;
+        if (!get(idx, d) || !get(idx, loc.segment) || !get(idx, loc.offset) || !get(idx, loc.stored) ||
+            !get(idx, loc.raw) || !get(idx, loc.codec)) break;     // EOF or a torn last record
+        auto seg = segmentBytes.find(loc.segment);
+        if (seg == segmentBytes.end() || loc.offset + loc.stored > seg->second) continue;
+        index.emplace(d, loc);
+    }
+}
+
+ChunkStore::ChunkStore(const fs::path& dir, const ChunkStoreOptions& opt) : impl_(new Impl{dir, opt}) {
+    std::error_code ec;
+    bool fresh = !fs::exists(dir, ec) || (fs::is_directory(dir, ec) && fs::is_empty(dir, ec));
+    try {
+        if (fresh) impl_->create();
+        impl_->load();
+    } catch (const fs::filesystem_error& e) {
+        throw std::runtime_error(e.what());
+    }
+}
+
+ChunkStore::~ChunkStore() = default;
+
+HashAlgo ChunkStore::hash() const { return impl_->opt.hash; }
+
+size_t ChunkStore::chunk_size() const { return impl_->opt.chunk_size; }
+
+bool ChunkStore::ingest(const std::vector<StoreFile>& files, Reporter& out) {
+    Impl& s = *impl_;
+    const auto t0 = std::chrono::steady_clock::now();
+    const unsigned workers = std::max(1u, s.opt.threads);
+    const size_t maxInFlight = 2 * (size_t)workers + 2;
+
+    // Pipeline state, all under `mu`.
+    std::mutex mu;
+    std::condition_variable workReady, claimTurn, doneReady, room;
+    std::deque<std::unique_ptr<Batch>> work;
+    std::map<size_t, std::unique_ptr<Batch>> done;             // by seq, waiting for the writer
+    size_t inFlight = 0, claimNext = 0, batches = 0;
+    bool reading = true, writeFailed = false;
+    std::unordered_set<Digest, DigestHash> claimed;            // stored by this run
+
+    // Workers: digest a batch, claim its new chunks in batch order (so the
+    // first occurrence is the one stored), compress those.
+    auto worker = [&] {
+        std::vector<const void*> ptrs;
+        std::vector<size_t> lens;
+        std::vector<Digest> digests;
+        for (;;) {
+            std::unique_ptr<Batch> b;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                workReady.wait(lock, [&] { return !work.empty() || !reading; });
+                if (work.empty()) return;
+                b = std::move(work.front());
+                work.pop_front();
+            }
+            const size_t n = b->chunks.size();
+            if (s.opt.hash == HashAlgo::Sha256) {
+                ptrs.resize(n);
+                lens.resize(n);
+                digests.resize(n);
+                for (size_t i = 0; i < n; ++i) {
+                    ptrs[i] = b->data.data() + b->chunks[i].off;
+                    lens[i] = b->chunks[i].len;
+                }
+                sha256_batch(ptrs.data(), lens.data(), n, digests.data());
+                for (size_t i = 0; i < n; ++i) b->chunks[i].digest = digests[i];
+            } else {
+                for (auto& c : b->chunks) c.digest = hash_bytes(s.opt.hash, b->data.data() + c.off, c.len);
+            }
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                claimTurn.wait(lock, [&] { return claimNext == b->seq; });
+                for (auto& c : b->chunks) c.fresh = !s.index.count(c.digest) && claimed.insert(c.digest).second;
+                ++claimNext;
+            }
+            claimTurn.notify_all();
+            // Incompressible data (media, archives) would cost a full deflate
+            // per chunk for nothing: after kGiveUp chunks in a row that did not
+            // shrink, only every kProbe-th one of the batch is tried.
+            size_t misses = 0, passed = 0;
+            for (auto& c : b->chunks) {
+                if (!c.fresh) continue;
+                c.packedOff = b->packed.size();
+                uLongf len = compressBound(c.len);
+                b->packed.resize(c.packedOff + len);
+                bool attempt = s.opt.compress_level > 0 && (misses < kGiveUp || ++passed % kProbe == 0);
+                if (attempt &&
+                    compress2(b->packed.data() + c.packedOff, &len, b->data.data() + c.off, c.len,
+                              s.opt.compress_level) == Z_OK && len < c.len) {
+                    c.codec = Deflate;
+                    misses = 0;
+                } else {
+                    std::memcpy(b->packed.data() + c.packedOff, b->data.data() + c.off, c.len);
+                    len = c.len;
+                    c.codec = Raw;
+                    misses += attempt;
+                }
+                c.packedLen = (std::uint32_t)len;
+                b->packed.resize(c.packedOff + len);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                done.emplace(b->seq, std::move(b));
+            }
+            doneReady.notify_one();
+        }
+    };
+
+    // Writer: batches in order into the segment; index records and recipes
+    // follow once the segment bytes they point to are on disk.
+    StoreSummaryRecord sum;
+    sum.store = s.dir;
+    std::vector<Problem> problems;
+    std::vector<std::pair<Digest, Location>> written;          // index records not yet committed
+    struct PendingRecipe {
+        std::uint32_t file;
+        std::uint64_t size;
+        std::int64_t mtime;
+        std::vector<RecipeEntry> entries;
+    };
+    std::vector<PendingRecipe> recipes;
+    auto writer = [&] {
+        std::ofstream seg;
+        std::uint32_t segNo = 0;
+        std::uint64_t segPos = 0;
+        bool segDirty = false, segCreated = false;              // not yet synced
+        bool failed = false;
+        std::vector<RecipeEntry> open;                          // chunks of the file being read
+        size_t sinceCommit = 0;                                 // batches
+        auto lastCommit = std::chrono::steady_clock::now();
+
+        auto fail = [&](const fs::path& p, const std::string& why) {
+            if (!failed) problems.push_back({ReportError::StoreWrite, p, why});
+            failed = true;
+        };
+        // Each step is on disk before the next one points into it: the
+        // segment, then the index records, then the recipes, then their names.
+        auto commit = [&] {
+            sinceCommit = 0;
+            lastCommit = std::chrono::steady_clock::now();
+            if (seg.is_open() && !seg.flush()) fail(segment_path(s.dir, segNo), "write failed");
+            if (!failed && segDirty && !sync_path(segment_path(s.dir, segNo))) {
+                fail(segment_path(s.dir, segNo), "cannot sync to disk");
+            }
+            if (!failed && segCreated && !sync_path(s.dir / "segments", true)) fail(s.dir / "segments", "cannot sync to disk");
+            segDirty = segCreated = false;
+            if (!failed && !written.empty()) {
+                {
+                    std::ofstream idx(s.dir / "index", std::ios::binary | std::ios::app);
+                    for (auto& [d, loc] : written) {
+                        put(idx, d); put(idx, loc.segment); put(idx, loc.offset); put(idx, loc.stored);
+                        put(idx, loc.raw); put(idx, loc.codec);
+                    }
+                    if (!idx.flush()) fail(s.dir / "index", "write failed");
+                }
+                if (!failed && !sync_path(s.dir / "index")) fail(s.dir / "index", "cannot sync to disk");
+                if (!failed) {
+                    // committed records move to the index the workers claim against
+                    std::lock_guard<std::mutex> lock(mu);
+                    for (auto& [d, loc] : written) {
+                        s.index.emplace(d, loc);
+                        claimed.erase(d);
+                    }
+                    written.clear();
+                }
+            }
+            std::vector<std::uint32_t> ready;
+            std::vector<fs::path> tmps;
+            for (auto& r : recipes) {
+                if (failed) {
+                    problems.push_back({ReportError::StoreWrite, files[r.file].path, "chunks not saved"});
+                    continue;
+                }
+                auto tmp = s.dir / "tmp" / (std::to_string(r.file) + ".recipe");
+                bool ok;
+                {
+                    std::ofstream rf(tmp, std::ios::binary | std::ios::trunc);
+                    rf.write(kRecipeMagic, sizeof(kRecipeMagic));
+                    put(rf, r.size); put(rf, r.mtime); put(rf, (std::uint64_t)r.entries.size());
+                    for (auto& e : r.entries) { put(rf, e.digest); put(rf, e.len); }
+                    ok = (bool)rf.flush();
+                }
+                if (!ok) {
+                    std::error_code ec;
+                    fs::remove(tmp, ec);
+                    problems.push_back({ReportError::StoreWrite, files[r.file].path,
+                                        "cannot write recipe " + files[r.file].name.string()});
+                    continue;
+                }
+                ready.push_back(r.file);
+                tmps.push_back(std::move(tmp));
+            }
+            recipes.clear();
+            if (ready.empty()) return;
+            const bool synced = sync_files(s.dir / "tmp", tmps);
+            std::set<fs::path> dirs;
+            for (size_t i = 0; i < ready.size(); ++i) {
+                auto& name = files[ready[i]].name;
+                auto dst = s.dir / "recipes" / name;
+                std::error_code ec;
+                if (synced) fs::create_directories(dst.parent_path(), ec);
+                if (synced && !ec) fs::rename(tmps[i], dst, ec);
+                if (!synced || ec) {
+                    fs::remove(tmps[i], ec);
+                    problems.push_back({ReportError::StoreWrite, files[ready[i]].path, "cannot write recipe " + name.string()});
+                    continue;
+                }
+                dirs.insert(dst.parent_path());
+                ++sum.files;
+            }
+            for (auto& d : dirs) sync_path(d, true);
+        };
+        auto add_chunk = [&](const Batch& b, const Batch::Chunk& c) {
+            ++sum.chunks;
+            sum.bytes += c.len;
+            open.push_back({c.digest, c.len});
+            if (!c.fresh || failed) return;
+            if (!seg.is_open() || segPos >= kSegmentBytes) {
+                if (seg.is_open()) {
+                    commit();
+                    seg.close();
+                }
+                segNo = s.nextSegment++;
+                seg.open(segment_path(s.dir, segNo), std::ios::binary | std::ios::trunc);
+                seg.write(kSegmentMagic, sizeof(kSegmentMagic));
+                segPos = sizeof(kSegmentMagic);
+                segCreated = true;
+                ++sum.segments;
+                if (!seg) return fail(segment_path(s.dir, segNo), "cannot create segment");
+            }
+            put(seg, c.len); put(seg, c.packedLen); put(seg, c.codec); put(seg, c.digest);
+            seg.write(reinterpret_cast<const char*>(b.packed.data() + c.packedOff), c.packedLen);
+            if (!seg) return fail(segment_path(s.dir, segNo), "write failed");
+            segDirty = true;
+            written.push_back({c.digest, Location{segNo, segPos + kRecordHeader, c.packedLen, c.len, c.codec}});
+            segPos += kRecordHeader + c.packedLen;
+            ++sum.new_chunks;
+            sum.new_bytes += c.len;
+            sum.stored_bytes += kRecordHeader + c.packedLen;
+        };
+
+        for (size_t next = 0;; ++next) {
+            std::unique_ptr<Batch> b;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                doneReady.wait(lock, [&] {
+                    return (!done.empty() && done.begin()->first == next) || (!reading && next == batches);
+                });
+                if (done.empty() || done.begin()->first != next) break;
+                b = std::move(done.begin()->second);
+                done.erase(done.begin());
+            }
+            size_t i = 0;
+            for (auto& e : b->ends) {
+                for (; i < e.chunks; ++i) add_chunk(*b, b->chunks[i]);
+                if (!e.error.empty()) problems.push_back({ReportError::Read, files[e.file].path, e.error});
+                else recipes.push_back({e.file, e.bytes, e.mtime, std::move(open)});
+                open.clear();
+            }
+            for (; i < b->chunks.size(); ++i) add_chunk(*b, b->chunks[i]);
+            // Besides each segment rollover: few new chunks must not keep every
+            // recipe in memory, and an interruption should lose little.
+            if (++sinceCommit >= kCommitBatches || std::chrono::steady_clock::now() - lastCommit >= kCommitInterval) {
+                commit();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                --inFlight;
+                writeFailed = writeFailed || failed;
+            }
+            room.notify_one();
+        }
+        commit();
+    };
+
+    // Two files under one recipe name: the later would replace the earlier.
+    std::vector<char> clash(files.size(), 0);
+    {
+        std::unordered_map<std::string, size_t> byName;
+        for (size_t i = 0; i < files.size(); ++i) {
+            auto [it, added] = byName.emplace(files[i].name.lexically_normal().generic_string(), i);
+            if (added) continue;
+            clash[i] = 1;
+            problems.push_back({ReportError::StoreWrite, files[i].path,
+                                "recipe name " + files[i].name.string() + " already used by " + files[it->second].path.string()});
+        }
+    }
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < workers; ++t) pool.emplace_back(worker);
+    std::thread writerThread(writer);
+
+    // Reader: chunk each file into the current batch; hand batches on as they fill.
+    Chunker chunker(s.opt.chunk_size);
+    auto b = std::make_unique<Batch>();
+    b->data.reserve(kBatchBytes + chunker.max_size());
+    auto submit = [&] {
+        std::unique_lock<std::mutex> lock(mu);
+        room.wait(lock, [&] { return inFlight < maxInFlight; });
+        b->seq = batches++;
+        ++inFlight;
+        work.push_back(std::move(b));
+        lock.unlock();
+        workReady.notify_one();
+        b = std::make_unique<Batch>();
+        b->data.reserve(kBatchBytes + chunker.max_size());
+    };
+    ChunkSink sink = [&](const unsigned char* data, size_t n) {
+        b->chunks.push_back({b->data.size(), (std::uint32_t)n});
+        b->data.insert(b->data.end(), data, data + n);
+        if (b->data.size() >= kBatchBytes) submit();
+    };
+    for (size_t i = 0; i < files.size(); ++i) {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            if (writeFailed) break;
+        }
+        if (clash[i]) continue;
+        Batch::FileEnd end{0, (std::uint32_t)i, 0, 0, {}};
+        std::error_code ec;
+        end.mtime = (std::int64_t)fs::last_write_time(files[i].path, ec).time_since_epoch().count();
+        try {
+            read_file_range(files[i].path, 0, UINTMAX_MAX, [&](const void* d, size_t n) {
+                end.bytes += n;
+                chunker.update(d, n, sink);
+            });
+            chunker.finish(sink);
+        } catch (const std::exception& e) {
+            chunker.finish([](const unsigned char*, size_t) {});
+            end.error = e.what();
+        }
+        end.chunks = b->chunks.size();
+        b->ends.push_back(std::move(end));
+    }
+    if (!b->chunks.empty() || !b->ends.empty()) submit();
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        reading = false;
+    }
+    workReady.notify_all();
+    doneReady.notify_all();
+    for (auto& t : pool) t.join();
+    writerThread.join();
+
+    for (auto& p : problems) out.error(p.kind, p.path, p.detail);
+    sum.failed = files.size() - sum.files;
+    sum.wall_ns = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+    stats_count(Stage::Store, sum.files, sum.bytes);
+    out.store_summary(sum);
+    return !writeFailed;
+}
+
+// One recipe back into a file, through a temporary next to it.
+void ChunkStore::Impl::restore_file(const fs::path& name, const fs::path& target, std::uint64_t& bytes) const {
+    std::ifstream rf(dir / "recipes" / name, std::ios::binary);
+    char magic[sizeof(kRecipeMagic)];
+    std::uint64_t size = 0, count = 0;
+    std::int64_t mtime = 0;
+    if (!rf.read(magic, sizeof(magic)) || std::memcmp(magic, kRecipeMagic, sizeof(magic)) != 0 ||
+        !get(rf, size) || !get(rf, mtime) || !get(rf, count)) throw std::runtime_error("unreadable recipe");
+
+    auto dst = target / name;
+    auto tmp = dst;
+    tmp += ".sp-restore";
+    fs::create_directories(dst.parent_path());
+    std::ofstream outFile(tmp, std::ios::binary | std::ios::trunc);
+    if (!outFile) throw std::runtime_error("cannot create " + tmp.string());
+    try {
+        std::map<std::uint32_t, std::ifstream> segments;
+        std::vector<unsigned char> stored, raw;
+        std::uint64_t total = 0;
+        for (std::uint64_t k = 0; k < count; ++k) {
+            RecipeEntry e;
+            if (!get(rf, e.digest) || !get(rf, e.len)) throw std::runtime_error("truncated recipe");
+            auto it = index.find(e.digest);
+            if (it == index.end() || it->second.raw != e.len) throw std::runtime_error("chunk missing from the store");
+            const Location& loc = it->second;
+            auto& seg = segments[loc.segment];
+            if (!seg.is_open()) seg.open(segment_path(dir, loc.segment), std::ios::binary);
+            stored.resize(loc.stored);
+            if (!seg.seekg((std::streamoff)loc.offset) || !seg.read(reinterpret_cast<char*>(stored.data()), loc.stored)) {
+                throw std::runtime_error("cannot read segment " + std::to_string(loc.segment));
+            }
+            const unsigned char* data = stored.data();
+            if (loc.codec == Deflate) {
+                raw.resize(loc.raw);
+                uLongf len = loc.raw;
+                if (uncompress(raw.data(), &len, stored.data(), loc.stored) != Z_OK || len != loc.raw) {
+                    throw std::runtime_error("corrupt chunk in segment " + std::to_string(loc.segment));
+                }
+                data = raw.data();
+            } else if (loc.stored != loc.raw) {
+                throw std::runtime_error("corrupt chunk in segment " + std::to_string(loc.segment));
+            }
+            if (hash_bytes(opt.hash, data, loc.raw) != e.digest) {
+                throw std::runtime_error("chunk digest mismatch in segment " + std::to_string(loc.segment));
+            }
+            outFile.write(reinterpret_cast<const char*>(data), loc.raw);
+            total += loc.raw;
+        }
+        if (total != size) throw std::runtime_error("recipe size mismatch");
+        if (!outFile.flush()) throw std::runtime_error("write failed");
+        outFile.close();
+        fs::rename(tmp, dst);
+        bytes = total;
+    } catch (...) {
+        outFile.close();
+        std::error_code ec;
+        fs::remove(tmp, ec);
+        throw;
+    }
+    std::error_code ec;
+    fs::last_write_time(dst, fs::file_time_type(fs::file_time_type::duration(mtime)), ec);
+}
+
+bool ChunkStore::restore(const fs::path& target, Reporter& out) {
+    Impl& s = *impl_;
+    const auto t0 = std::chrono::steady_clock::now();
+    RestoreSummaryRecord sum;
+    sum.store = s.dir;
+    sum.target = target;
+
+    // Recipe names in path order, so errors come out in a stable order.
+    std::vector<fs::path> names;
+    std::error_code ec;
+    auto recipes = s.dir / "recipes";
+    for (auto it = fs::recursive_directory_iterator(recipes, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (it->is_regular_file(ec)) names.push_back(it->path().lexically_relative(recipes));
+    }
+    if (ec) out.error(ReportError::Restore, recipes, ec.message());
+    std::sort(names.begin(), names.end());
+
+    std::vector<std::string> errors(names.size());
+    std::vector<std::uint64_t> bytes(names.size());
+    parallel_for(names.size(), s.opt.threads, [&](size_t i) {
+        try {
+            s.restore_file(names[i], target, bytes[i]);
+        } catch (const std::exception& e) {
+            errors[i] = e.what();
+        }
+    });
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!errors[i].empty()) {
+            out.error(ReportError::Restore, names[i], errors[i]);
+            ++sum.failed;
+            continue;
+        }
+        ++sum.files;
+        sum.bytes += bytes[i];
+    }
+    if (ec) ++sum.failed;
+    sum.wall_ns = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+    out.restore_summary(sum);
+    return sum.failed == 0;
+}
@@ -0,0 +1,265 @@
+#include "chunker.h"
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SP_GEAR_X86 1
+#define SP_GEAR_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define SP_GEAR_X86 1
+#define SP_GEAR_TARGET(isa)         // MSVC takes any ISA's intrinsics without flags
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+    // splitmix64 from a fixed seed: the table is part of the chunk boundaries
+    // and must never change.
+    struct GearTable { std::uint64_t v[256]; };
+    constexpr GearTable make_gear() {
+        GearTable t{};
+        std::uint64_t x = 0x53502d4445445550ull;
+        for (int i = 0; i < 256; ++i) {
+            x += 0x9E3779B97F4A7C15ull;
+            std::uint64_t z = x;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            t.v[i] = z ^ (z >> 31);
+        }
+        return t;
+    }
+    alignas(64) constexpr GearTable kGear = make_gear();
+
+    const size_t kWindow = 64;              // bytes that reach a 64-bit Gear hash
+
+    void candidates_scalar(const unsigned char* p, size_t begin, size_t end,
+                           std::uint64_t loose, std::uint64_t strict, std::vector<GearCandidate>& out) {
+        std::uint64_t h = 0;
+        size_t i = begin > kWindow ? begin - kWindow : 0;
+        for (; i < begin; ++i) h = (h << 1) + kGear.v[p[i]];
+        for (; i < end; ++i) {
+            h = (h << 1) + kGear.v[p[i]];
+            if (!(h & loose)) out.push_back({(std::uint32_t)i, !(h & strict)});
+        }
+    }
+
+#ifdef SP_GEAR_X86
+    // Lane j rolls its own hash over the j-th slice of [begin, end), after
+    // warming up on the 64 bytes in front of it; each step gathers eight bytes
+    // per lane, then one table entry per byte. Returns where the slices end
+    // (the caller finishes the remainder). Needs begin >= 64.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"   // GCC 12 on _mm512_undefined_epi32()
+#endif
+    SP_GEAR_TARGET("avx512f")
+    size_t candidates_x8(const unsigned char* p, size_t begin, size_t end,
+                         std::uint64_t loose, std::uint64_t strict, std::vector<GearCandidate>& out) {
+        const size_t lane = ((end - begin) / 8) & ~size_t(7);
+        if (lane < kWindow) return begin;
+        thread_local std::vector<GearCandidate> found[8];
+        alignas(64) long long start[8];
+        for (int j = 0; j < 8; ++j) {
+            found[j].clear();
+            start[j] = (long long)(begin + j * lane - kWindow);
+        }
+        const __m512i off = _mm512_load_si512(start);
+        const __m512i low = _mm512_set1_epi64(0xFF);
+        const __m512i vloose = _mm512_set1_epi64((long long)loose);
+        const void* gear = kGear.v;
+        __m512i h = _mm512_setzero_si512();
+        for (size_t t = 0; t < kWindow + lane; t += 8) {
+            __m512i q = _mm512_i64gather_epi64(_mm512_add_epi64(off, _mm512_set1_epi64((long long)t)), p, 1);
+            for (size_t k = 0; k < 8; ++k) {
+                __m512i g = _mm512_i64gather_epi64(_mm512_and_si512(q, low), gear, 8);
+                h = _mm512_add_epi64(_mm512_slli_epi64(h, 1), g);
+                q = _mm512_srli_epi64(q, 8);
+                if (t < kWindow) continue;
+                __mmask8 m = _mm512_testn_epi64_mask(h, vloose);
+                if (!m) continue;
+                alignas(64) std::uint64_t hv[8];
+                _mm512_store_si512(hv, h);
+                for (int j = 0; j < 8; ++j) {
+                    if (m & (1u << j)) {
+                        found[j].push_back({(std::uint32_t)(begin + j * lane + t + k - kWindow), !(hv[j] & strict)});
+                    }
+                }
+            }
+        }
+        for (auto& f : found) out.insert(out.end(), f.begin(), f.end());
+        return begin + 8 * lane;
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+    SP_GEAR_TARGET("avx2")
+    size_t candidates_x4(const unsigned char* p, size_t begin, size_t end,
+                         std::uint64_t loose, std::uint64_t strict, std::vector<GearCandidate>& out) {
+        const size_t lane = ((end - begin) / 4) & ~size_t(7);
+        if (lane < kWindow) return begin;
+        thread_local std::vector<GearCandidate> found[4];
+        for (auto& f : found) f.clear();
+        const __m256i off = _mm256_set_epi64x((long long)(begin + 3 * lane - kWindow), (long long)(begin + 2 * lane - kWindow),
+                                              (long long)(begin + lane - kWindow), (long long)(begin - kWindow));
+        const __m256i low = _mm256_set1_epi64x(0xFF);
+        const __m256i vloose = _mm256_set1_epi64x((long long)loose);
+        const __m256i zero = _mm256_setzero_si256();
+        const long long* bytes = reinterpret_cast<const long long*>(p);
+        const long long* gear = reinterpret_cast<const long long*>(kGear.v);
+        __m256i h = zero;
+        for (size_t t = 0; t < kWindow + lane; t += 8) {
+            __m256i q = _mm256_i64gather_epi64(bytes, _mm256_add_epi64(off, _mm256_set1_epi64x((long long)t)), 1);
+            for (size_t k = 0; k < 8; ++k) {
+                __m256i g = _mm256_i64gather_epi64(gear, _mm256_and_si256(q, low), 8);
+                h = _mm256_add_epi64(_mm256_slli_epi64(h, 1), g);
+                q = _mm256_srli_epi64(q, 8);
+                if (t < kWindow) continue;
+                int m = _mm256_movemask_pd(_mm256_castsi256_pd(
+                    _mm256_cmpeq_epi64(_mm256_and_si256(h, vloose), zero)));
+                if (!m) continue;
+                alignas(32) std::uint64_t hv[4];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(hv), h);
+                for (int j = 0; j < 4; ++j) {
+                    if (m & (1 << j)) {
+                        found[j].push_back({(std::uint32_t)(begin + j * lane + t + k - kWindow), !(hv[j] & strict)});
+                    }
+                }
+            }
+        }
+        for (auto& f : found) out.insert(out.end(), f.begin(), f.end());
+        return begin + 4 * lane;
+    }
+
+    bool cpu_has(GearBackend b) {
+#if defined(__GNUC__)
+        __builtin_cpu_init();
+        return b == GearBackend::Avx512 ? __builtin_cpu_supports("avx512f") : __builtin_cpu_supports("avx2");
+#else
+        int r[4];
+        __cpuid(r, 1);
+        if (!(r[2] & (1 << 27))) return false;                  // OSXSAVE
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(r, 7, 0);
+        if (b == GearBackend::Avx512) return (r[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6;
+        return (r[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+#endif
+    }
+#endif
+
+    // Four lanes of AVX2 gathers barely beat the scalar loop (measured ~7%),
+    // so they are only used when asked for.
+    GearBackend detect() {
+        if (gear_backend_supported(GearBackend::Avx512)) return GearBackend::Avx512;
+        return GearBackend::Scalar;
+    }
+
+    GearBackend g_backend = detect();
+
+    const size_t kBlock = size_t(1) << 20;  // bytes scanned for candidates at a time
+}
+
+const char* gear_backend_name(GearBackend b) {
+    switch (b) {
+        case GearBackend::Scalar: return "scalar";
+        case GearBackend::Avx2:   return "avx2";
+        case GearBackend::Avx512: return "avx512";
+    }
+    return "?";
+}
+
+bool gear_backend_supported(GearBackend b) {
+    if (b == GearBackend::Scalar) return true;
+#ifdef SP_GEAR_X86
+    return cpu_has(b);
+#else
+    return false;
+#endif
+}
+
+GearBackend gear_active_backend() { return g_backend; }
+
+bool gear_set_backend(GearBackend b) {
+    if (!gear_backend_supported(b)) return false;
+    g_backend = b;
+    return true;
+}
+
+void gear_candidates(const unsigned char* data, size_t begin, size_t end,
+                     std::uint64_t loose_mask, std::uint64_t strict_mask, std::vector<GearCandidate>& out) {
+    if (begin < kWindow) {      // stream start: the window is still filling
+        size_t head = std::min(end, kWindow);
+        candidates_scalar(data, begin, head, loose_mask, strict_mask, out);
+        begin = head;
+    }
+    if (begin >= end) return;
+#ifdef SP_GEAR_X86
+    if (g_backend == GearBackend::Avx512) begin = candidates_x8(data, begin, end, loose_mask, strict_mask, out);
+    else if (g_backend == GearBackend::Avx2) begin = candidates_x4(data, begin, end, loose_mask, strict_mask, out);
+#endif
+    candidates_scalar(data, begin, end, loose_mask, strict_mask, out);
+}
+
+Chunker::Chunker(size_t avg_size) : min_(avg_size / 4), avg_(avg_size), max_(avg_size * 8) {
+    unsigned bits = 0;
+    while ((size_t(1) << bits) < avg_size) ++bits;
+    loose_ = ~std::uint64_t(0) << (64 - (bits - 2));
+    strict_ = ~std::uint64_t(0) << (64 - (bits + 2));
+}
+
+void Chunker::update(const void* data, size_t n, const ChunkSink& emit) {
+    auto p = static_cast<const unsigned char*>(data);
+    while (n) {
+        size_t take = std::min(n, kBlock);
+        buf_.insert(buf_.end(), p, p + take);
+        p += take;
+        n -= take;
+        if (buf_.size() - start_ >= kBlock) cut(false, emit);
+    }
+}
+
+void Chunker::finish(const ChunkSink& emit) {
+    cut(true, emit);
+    buf_.clear();
+    cands_.clear();
+    start_ = scanned_ = nextCand_ = 0;
+}
+
+// Emit every chunk whose end is already decided: the first strong candidate
+// from min to avg bytes in, else the first candidate up to max, else max.
+// Without `last`, a chunk with no candidate yet and fewer than max bytes
+// waits for more input.
+void Chunker::cut(bool last, const ChunkSink& emit) {
+    gear_candidates(buf_.data(), scanned_, buf_.size(), loose_, strict_, cands_);
+    scanned_ = buf_.size();
+    for (;;) {
+        size_t avail = buf_.size() - start_;
+        if (!avail) break;
+        while (nextCand_ < cands_.size() && cands_[nextCand_].pos + 1 < start_ + min_) ++nextCand_;
+        size_t len = 0;
+        for (size_t k = nextCand_; k < cands_.size(); ++k) {
+            size_t l = cands_[k].pos + 1 - start_;
+            if (l > max_) break;
+            if (cands_[k].strong || l > avg_) { len = l; break; }
+        }
+        if (!len) {
+            if (avail >= max_) len = max_;
+            else if (last) len = avail;
+            else break;
+        }
+        emit(buf_.data() + start_, len);
+        start_ += len;
+    }
+
+    // Keep a window's worth of history in front of the open chunk.
+    if (start_ <= kWindow) return;
+    size_t drop = start_ - kWindow;
+    auto live = std::find_if(cands_.begin() + nextCand_, cands_.end(),
+                             [&](const GearCandidate& c) { return c.pos >= start_; });
+    cands_.erase(cands_.begin(), live);
+    for (auto& c : cands_) c.pos -= (std::uint32_t)drop;
+    nextCand_ = 0;
+    buf_.erase(buf_.begin(), buf_.begin() + drop);
+    start_ -= drop;
+    scanned_ -= drop;
+}
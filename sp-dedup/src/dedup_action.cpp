@@ -0,0 +1,138 @@
+#include "dedup_action.h"
+#include <algorithm>
+#include <cstdint>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool parse_dedup_action(const std::string& name, DedupAction& out) {
+    if (name == "delete") out = DedupAction::Delete;
+    else if (name == "hardlink") out = DedupAction::Hardlink;
+    else if (name == "reflink") out = DedupAction::Reflink;
+    else return false;
+    return true;
+}
+
+const char* dedup_action_name(DedupAction a) {
+    switch (a) {
+        case DedupAction::Delete:   return "delete";
+        case DedupAction::Hardlink: return "hardlink";
+        case DedupAction::Reflink:  return "reflink";
+    }
+    return "?";
+}
+
+bool hardlink_replace(const std::filesystem::path& keep, const std::filesystem::path& dup,
+                      std::error_code& ec) {
+    namespace fs = std::filesystem;
+    // Linking a symlink links the symlink itself; renaming that over its own
+    // target would leave a link to nothing. Paths to one inode are already one
+    // file; rename() between them does nothing and would strand the temp link.
+    if (fs::symlink_status(keep, ec).type() == fs::file_type::symlink ||
+        (!ec && fs::symlink_status(dup, ec).type() == fs::file_type::symlink)) {
+        ec = std::make_error_code(std::errc::operation_not_supported);
+        return false;
+    }
+    if (ec) return false;
+    if (fs::equivalent(keep, dup, ec)) {
+        ec = std::make_error_code(std::errc::file_exists);
+        return false;
+    }
+    if (ec) return false;
+    fs::path tmp;
+    for (int attempt = 0; ; ++attempt) {
+        tmp = dup;
+        tmp += ".spdlink" + std::to_string(attempt) + ".tmp";
+        fs::create_hard_link(keep, tmp, ec);
+        if (!ec) break;
+        if (ec != std::errc::file_exists || attempt == 8) return false;
+    }
+    fs::rename(tmp, dup, ec);
+    if (ec) {
+        std::error_code ignored;
+        fs::remove(tmp, ignored);
+        return false;
+    }
+    return true;
+}
+
+#ifdef __linux__
+
+namespace {
+    // btrfs dedupes at most 16 MiB per request; XFS accepts more but gains nothing.
+    const std::uint64_t kChunk = std::uint64_t(16) << 20;
+    // Header plus infos must fit in one page, the kernel's limit.
+    const size_t kMaxDest = (4096 - sizeof(file_dedupe_range)) / sizeof(file_dedupe_range_info);
+
+    struct Fd {
+        int fd = -1;
+        ~Fd() { if (fd >= 0) ::close(fd); }
+    };
+}
+
+std::vector<ReflinkStatus> reflink_dedupe(const std::filesystem::path& keep,
+                                          const std::vector<std::filesystem::path>& dups) {
+    std::vector<ReflinkStatus> out(dups.size(), ReflinkStatus::Failed);
+    Fd src;
+    src.fd = ::open(keep.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (src.fd < 0 || ::fstat(src.fd, &st) != 0) return out;
+    const std::uint64_t size = (std::uint64_t)st.st_size;
+
+    // Destinations need write access unless we own them (Linux 4.19+).
+    std::vector<Fd> dst(dups.size());
+    std::vector<size_t> live;
+    for (size_t i = 0; i < dups.size(); ++i) {
+        dst[i].fd = ::open(dups[i].c_str(), O_RDWR | O_CLOEXEC);
+        if (dst[i].fd < 0) dst[i].fd = ::open(dups[i].c_str(), O_RDONLY | O_CLOEXEC);
+        if (dst[i].fd < 0) continue;
+        out[i] = ReflinkStatus::Shared;
+        live.push_back(i);
+    }
+
+    std::vector<unsigned char> buf(sizeof(file_dedupe_range) + kMaxDest * sizeof(file_dedupe_range_info));
+    auto* req = reinterpret_cast<file_dedupe_range*>(buf.data());
+    for (std::uint64_t off = 0; off < size && !live.empty(); off += kChunk) {
+        const std::uint64_t len = std::min(kChunk, size - off);
+        std::vector<size_t> next;
+        for (size_t b = 0; b < live.size(); b += kMaxDest) {
+            size_t n = std::min(kMaxDest, live.size() - b);
+            std::fill(buf.begin(), buf.end(), 0);
+            req->src_offset = off;
+            req->src_length = len;
+            req->dest_count = (std::uint16_t)n;
+            for (size_t k = 0; k < n; ++k) {
+                req->info[k].dest_fd = dst[live[b + k]].fd;
+                req->info[k].dest_offset = off;
+            }
+            bool ok = ::ioctl(src.fd, FIDEDUPERANGE, req) == 0;
+            for (size_t k = 0; k < n; ++k) {
+                size_t i = live[b + k];
+                const auto& r = req->info[k];
+                if (!ok || r.status < 0 || (r.status == FILE_DEDUPE_RANGE_SAME && r.bytes_deduped != len)) {
+                    out[i] = ReflinkStatus::Failed;
+                } else if (r.status == FILE_DEDUPE_RANGE_DIFFERS) {
+                    out[i] = ReflinkStatus::Differs;
+                } else {
+                    next.push_back(i);
+                }
+            }
+        }
+        live.swap(next);
+    }
+    return out;
+}
+
+#else
+
+std::vector<ReflinkStatus> reflink_dedupe(const std::filesystem::path&,
+                                          const std::vector<std::filesystem::path>& dups) {
+    return std::vector<ReflinkStatus>(dups.size(), ReflinkStatus::Failed);
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "docx_dedup.h"
 #include "zip_util.h"
 #include "hasher.h"
+#include "stats.h"
 #include <tinyxml2.h>
 #include <unordered_set>
 #include <sstream>
@@ -28,25 +29,32 @@ bool docx_dedupe_paragraphs_inplace(const std::filesystem::path& docx, bool comm
     }
 
     XMLDocument d;
-    if (d.Parse(xml.c_str(), xml.size()) != XML_SUCCESS) {
+    XMLError parsed;
+    {
+        StageTimer timer(Stage::XmlParse, xml.size());
+        parsed = d.Parse(xml.c_str(), xml.size());
+    }
+    if (parsed != XML_SUCCESS) {
         report += "  [WARN] XML parse failed — skipping.\n";
         return false;
     }
 
     // paragraphs are w:p
-    std::unordered_set<std::string> seen;
+    std::unordered_set<Digest, DigestHash> seen;
     std::vector<XMLElement*> toDelete;
 
-    for (XMLElement* p = d.RootElement()->FirstChildElement(); p; p = p->NextSiblingElement()) {
-        const char* nm = p->Name();
-        if (!nm || std::string(nm).find(":p") == std::string::npos) continue;
-        std::string text = get_text_concat(p);
-        // Normalize whitespace a bit
-        if (!text.empty()) {
-            // hash the text to decide duplicates
-            std::string h = sha256_hex(text);
-            if (!seen.insert(h).second) {
-                toDelete.push_back(p);
+    {
+        StageTimer timer(Stage::XmlDedupe, xml.size());
+        for (XMLElement* p = d.RootElement()->FirstChildElement(); p; p = p->NextSiblingElement()) {
+            const char* nm = p->Name();
+            if (!nm || std::string(nm).find(":p") == std::string::npos) continue;
+            std::string text = get_text_concat(p);
+            // Normalize whitespace a bit
+            if (!text.empty()) {
+                // hash the text to decide duplicates
+                if (!seen.insert(sha256(text.data(), text.size())).second) {
+                    toDelete.push_back(p);
+                }
             }
         }
     }
@@ -61,7 +69,11 @@ bool docx_dedupe_paragraphs_inplace(const std::filesystem::path& docx, bool comm
     if (commit) {
         for (auto* p : toDelete) p->Parent()->DeleteChild(p);
         XMLPrinter pr;
-        d.Print(&pr);
+        {
+            StageTimer timer(Stage::XmlWrite);
+            d.Print(&pr);
+            timer.bytes((std::uint64_t)pr.CStrSize() - 1);
+        }
         if (!zip_write_file_replace(docx.string(), "word/document.xml", pr.CStr())) {
             report += "  [ERR] Failed to write document.xml back.\n";
             return false;
@@ -0,0 +1,168 @@
+#include "external_sort.h"
+#include <algorithm>
+#include <functional>
+
+namespace {
+    namespace fs = std::filesystem;
+
+    const size_t kMaxFanIn = 64;                // runs merged at once
+    const size_t kReadBuffer = size_t(1) << 16; // per run while merging
+
+    bool record_less(const FileInfo& a, const FileInfo& b) {
+        if (a.size != b.size) return a.size < b.size;
+        return a.path < b.path;
+    }
+
+    size_t record_bytes(const FileInfo& f) {
+        return sizeof(FileInfo) + f.path.native().size() * sizeof(fs::path::value_type);
+    }
+
+    template <class T> void put(std::ostream& o, T v) { o.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    template <class T> bool get(std::istream& i, T& v) { return (bool)i.read(reinterpret_cast<char*>(&v), sizeof(v)); }
+
+    // size, dev, ino, nlink, path length (in path characters), path
+    void write_record(std::ostream& o, const FileInfo& f) {
+        const auto& s = f.path.native();
+        put(o, (std::uint64_t)f.size);
+        put(o, f.dev);
+        put(o, f.ino);
+        put(o, f.nlink);
+        put(o, (std::uint32_t)s.size());
+        o.write(reinterpret_cast<const char*>(s.data()), (std::streamsize)(s.size() * sizeof(s[0])));
+    }
+
+    bool read_record(std::istream& i, FileInfo& f) {
+        std::uint64_t size = 0;
+        std::uint32_t len = 0;
+        if (!get(i, size) || !get(i, f.dev) || !get(i, f.ino) || !get(i, f.nlink) || !get(i, len)) return false;
+        fs::path::string_type s(len, 0);
+        if (!i.read(reinterpret_cast<char*>(&s[0]), (std::streamsize)(len * sizeof(s[0])))) return false;
+        f.size = (std::uintmax_t)size;
+        f.path = std::move(s);
+        return true;
+    }
+}
+
+struct ExternalFileSort::Reader {
+    std::vector<char> buf = std::vector<char>(kReadBuffer);
+    std::ifstream in;
+    FileInfo head;
+    bool live = false;
+
+    bool open(const fs::path& p) {
+        in.rdbuf()->pubsetbuf(buf.data(), (std::streamsize)buf.size());
+        in.open(p, std::ios::binary);
+        if (!in) return false;
+        advance();
+        return true;
+    }
+    void advance() { live = read_record(in, head); }
+};
+
+ExternalFileSort::ExternalFileSort(fs::path tmp_dir, size_t budget)
+    : dir_(std::move(tmp_dir)), budget_(std::max<size_t>(budget, size_t(1) << 20)) {}
+
+ExternalFileSort::~ExternalFileSort() {
+    readers_.clear();
+    std::error_code ec;
+    for (auto& r : runs_) fs::remove(r, ec);
+}
+
+fs::path ExternalFileSort::new_run_path() {
+    // several instances may share a temp directory
+    return dir_ / ("sp_dedup_run_" + std::to_string((std::uintptr_t)this) + "_" + std::to_string(nextRun_++) + ".tmp");
+}
+
+bool ExternalFileSort::add(FileInfo f) {
+    bufBytes_ += record_bytes(f);
+    buf_.push_back(std::move(f));
+    ++records_;
+    return bufBytes_ < budget_ || spill();
+}
+
+bool ExternalFileSort::spill() {
+    std::sort(buf_.begin(), buf_.end(), record_less);
+    auto path = new_run_path();
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        for (auto& f : buf_) write_record(out, f);
+        if (!out) return false;
+    }
+    runs_.push_back(path);
+    std::vector<FileInfo>().swap(buf_);
+    bufBytes_ = 0;
+    return true;
+}
+
+bool ExternalFileSort::merge_runs(size_t first, size_t count) {
+    std::vector<Reader> in(count);
+    for (size_t k = 0; k < count; ++k) if (!in[k].open(runs_[first + k])) return false;
+    auto path = new_run_path();
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        for (;;) {
+            Reader* best = nullptr;
+            for (auto& r : in) if (r.live && (!best || record_less(r.head, best->head))) best = &r;
+            if (!best) break;
+            write_record(out, best->head);
+            best->advance();
+        }
+        if (!out) return false;
+    }
+    in.clear();
+    std::error_code ec;
+    for (size_t k = 0; k < count; ++k) fs::remove(runs_[first + k], ec);
+    runs_.erase(runs_.begin() + first, runs_.begin() + first + count);
+    runs_.insert(runs_.begin() + first, path);
+    return true;
+}
+
+bool ExternalFileSort::rewind() {
+    readers_.clear();
+    heap_.clear();
+    pos_ = 0;
+    if (runs_.empty()) {
+        // never spilled: everything is already in memory
+        std::sort(buf_.begin(), buf_.end(), record_less);
+        return true;
+    }
+    if (!buf_.empty() && !spill()) return false;
+    // Pre-merge until one pass of kMaxFanIn readers covers every run.
+    while (runs_.size() > kMaxFanIn) {
+        for (size_t first = 0; first < runs_.size(); ++first) {
+            size_t count = std::min(kMaxFanIn, runs_.size() - first);
+            if (count < 2) break;
+            if (!merge_runs(first, count)) return false;
+        }
+    }
+    for (auto& r : runs_) {
+        readers_.push_back(std::make_unique<Reader>());
+        if (!readers_.back()->open(r)) return false;
+        if (readers_.back()->live) heap_.push_back(readers_.size() - 1);
+    }
+    auto greater = [this](size_t a, size_t b) { return record_less(readers_[b]->head, readers_[a]->head); };
+    std::make_heap(heap_.begin(), heap_.end(), greater);
+    return true;
+}
+
+bool ExternalFileSort::next_group(std::vector<FileInfo>& group) {
+    group.clear();
+    if (runs_.empty()) {
+        if (pos_ >= buf_.size()) return false;
+        auto size = buf_[pos_].size;
+        while (pos_ < buf_.size() && buf_[pos_].size == size) group.push_back(buf_[pos_++]);
+        return true;
+    }
+    auto greater = [this](size_t a, size_t b) { return record_less(readers_[b]->head, readers_[a]->head); };
+    while (!heap_.empty()) {
+        auto& top = *readers_[heap_.front()];
+        if (!group.empty() && top.head.size != group.front().size) break;
+        std::pop_heap(heap_.begin(), heap_.end(), greater);
+        size_t r = heap_.back();
+        group.push_back(std::move(readers_[r]->head));
+        readers_[r]->advance();
+        if (readers_[r]->live) std::push_heap(heap_.begin(), heap_.end(), greater);
+        else heap_.pop_back();
+    }
+    return !group.empty();
+}
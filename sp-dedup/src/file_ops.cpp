@@ -3,6 +3,18 @@
 #include <fstream>
 #include <unordered_set>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include "hash_cache.h"     // file_stamp(): volume serial and file index
+#else
+#include <sys/stat.h>
+#endif
 
 static bool has_ext(const std::filesystem::path& p, const std::vector<std::string>& whitelist) {
     if (whitelist.empty()) return true;
@@ -15,27 +27,168 @@ static bool has_ext(const std::filesystem::path& p, const std::vector<std::strin
     return false;
 }
 
-std::vector<FileInfo> list_target_files(const std::filesystem::path& dir, bool recurse,
-                                        const std::vector<std::string>& only_exts) {
-    std::vector<FileInfo> out;
-    std::error_code ec;
-    if (!std::filesystem::exists(dir, ec)) return out;
-
-    if (recurse) {
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(dir, ec)) {
-            if (ec) break;
-            if (!entry.is_regular_file()) continue;
-            if (!has_ext(entry.path(), only_exts)) continue;
-            out.push_back({entry.path(), (std::uintmax_t)entry.file_size()});
-        }
-    } else {
-        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
-            if (ec) break;
-            if (!entry.is_regular_file()) continue;
-            if (!has_ext(entry.path(), only_exts)) continue;
-            out.push_back({entry.path(), (std::uintmax_t)entry.file_size()});
+namespace {
+    namespace fs = std::filesystem;
+
+    // Size and inode identity of a regular file; false for symlinks, anything
+    // else, or on error. A symlink is not a copy of its target: acting on it
+    // as one would delete or relink the only data. One lstat() per file on POSIX.
+    bool stat_entry(const fs::directory_entry& entry, FileInfo& out) {
+        out.path = entry.path();
+#ifdef _WIN32
+        std::error_code ec;
+        if (entry.is_symlink(ec) || ec || !entry.is_regular_file(ec)) return false;
+        out.size = (std::uintmax_t)entry.file_size(ec);
+        if (ec) return false;
+        auto links = entry.hard_link_count(ec);
+        out.nlink = ec ? 1 : (std::uint32_t)links;
+        if (out.nlink > 1) {
+            // The file index needs a handle, so only linked files pay for one.
+            FileStamp st;
+            if (file_stamp(out.path, st)) { out.dev = st.dev; out.ino = st.ino; }
+            else out.nlink = 1;
         }
+#else
+        struct stat st{};
+        if (::lstat(out.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+        out.size = (std::uintmax_t)st.st_size;
+        out.dev = (std::uint64_t)st.st_dev;
+        out.ino = (std::uint64_t)st.st_ino;
+        out.nlink = (std::uint32_t)st.st_nlink;
+#endif
+        return true;
     }
+
+    // Work-stealing directory walker. Each thread owns a deque of directories:
+    // it pushes and pops subdirectories at the back (depth-first, so queues stay
+    // short) and, when empty, steals from the front of another thread's deque,
+    // which holds the shallowest and therefore largest pending subtrees.
+    class Walker {
+    public:
+        Walker(bool recurse, const std::vector<std::string>& exts, unsigned threads,
+               const std::function<void(FileInfo&&)>& sink)
+            : recurse_(recurse), exts_(exts), queues_(std::max(1u, threads)), sink_(sink) {}
+
+        void run(const fs::path& root) {
+            push(0, root);
+            std::vector<std::thread> pool;
+            for (unsigned t = 1; t < queues_.size(); ++t) pool.emplace_back([this, t] { work(t); });
+            work(0);   // calling thread takes a share too
+            for (auto& th : pool) th.join();
+        }
+
+    private:
+        struct Queue {
+            std::mutex mu;
+            std::deque<fs::path> dirs;
+        };
+
+        void push(unsigned self, fs::path dir) {
+            ++pending_;
+            {
+                std::lock_guard<std::mutex> lk(queues_[self].mu);
+                queues_[self].dirs.push_back(std::move(dir));
+            }
+            ++queued_;
+            idleCv_.notify_one();
+        }
+
+        bool pop(unsigned self, fs::path& dir) {
+            auto& q = queues_[self];
+            std::lock_guard<std::mutex> lk(q.mu);
+            if (q.dirs.empty()) return false;
+            dir = std::move(q.dirs.back());
+            q.dirs.pop_back();
+            --queued_;
+            return true;
+        }
+
+        bool steal(unsigned self, fs::path& dir) {
+            for (size_t k = 1; k < queues_.size(); ++k) {
+                auto& q = queues_[(self + k) % queues_.size()];
+                std::lock_guard<std::mutex> lk(q.mu);
+                if (q.dirs.empty()) continue;
+                dir = std::move(q.dirs.front());
+                q.dirs.pop_front();
+                --queued_;
+                return true;
+            }
+            return false;
+        }
+
+        void work(unsigned self) {
+            std::vector<FileInfo> batch;
+            fs::path dir;
+            for (;;) {
+                if (pop(self, dir) || steal(self, dir)) {
+                    scan(self, dir, batch);
+                    if (--pending_ == 0) {
+                        std::lock_guard<std::mutex> lk(idleMu_);
+                        idleCv_.notify_all();
+                    }
+                    continue;
+                }
+                if (pending_ == 0) break;
+                // A push can slip between the check and the wait; the timeout covers it.
+                std::unique_lock<std::mutex> lk(idleMu_);
+                idleCv_.wait_for(lk, std::chrono::milliseconds(1),
+                                 [&] { return pending_ == 0 || queued_ > 0; });
+            }
+            flush(batch);
+        }
+
+        void scan(unsigned self, const fs::path& dir, std::vector<FileInfo>& batch) {
+            std::error_code ec;
+            fs::directory_iterator it(dir, ec), end;
+            for (; !ec && it != end; it.increment(ec)) {
+                const auto& entry = *it;
+                std::error_code eec;
+                if (recurse_ && entry.symlink_status(eec).type() == fs::file_type::directory) {
+                    push(self, entry.path());
+                    continue;
+                }
+                if (!has_ext(entry.path(), exts_)) continue;
+                FileInfo fi;
+                if (!stat_entry(entry, fi)) continue;
+                batch.push_back(std::move(fi));
+                if (batch.size() >= 256) flush(batch);
+            }
+        }
+
+        void flush(std::vector<FileInfo>& batch) {
+            if (batch.empty()) return;
+            std::lock_guard<std::mutex> lk(sinkMu_);
+            for (auto& f : batch) sink_(std::move(f));
+            batch.clear();
+        }
+
+        bool recurse_;
+        const std::vector<std::string>& exts_;
+        std::vector<Queue> queues_;
+        const std::function<void(FileInfo&&)>& sink_;
+
+        std::atomic<size_t> pending_{0};    // directories pushed but not yet scanned
+        std::atomic<size_t> queued_{0};     // of those, still sitting in a deque
+        std::mutex idleMu_;
+        std::condition_variable idleCv_;
+        std::mutex sinkMu_;
+    };
+}
+
+void walk_target_files(const std::filesystem::path& dir, bool recurse,
+                       const std::vector<std::string>& only_exts, unsigned threads,
+                       const std::function<void(FileInfo&&)>& sink) {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(dir, ec)) return;
+    Walker(recurse, only_exts, threads, sink).run(dir);
+}
+
+std::vector<FileInfo> list_target_files(const std::filesystem::path& dir, bool recurse,
+                                        const std::vector<std::string>& only_exts,
+                                        unsigned threads) {
+    std::vector<FileInfo> out;
+    walk_target_files(dir, recurse, only_exts, threads, [&](FileInfo&& f) { out.push_back(std::move(f)); });
+    std::sort(out.begin(), out.end(), [](const FileInfo& a, const FileInfo& b) { return a.path < b.path; });
     return out;
 }
 
@@ -44,6 +197,24 @@ bool delete_file(const std::filesystem::path& p) {
     return std::filesystem::remove(p, ec);
 }
 
+bool files_identical(const std::filesystem::path& a, const std::filesystem::path& b) {
+    std::error_code ec;
+    auto sa = std::filesystem::file_size(a, ec);
+    if (ec || sa != std::filesystem::file_size(b, ec) || ec) return false;
+
+    std::ifstream fa(a, std::ios::binary), fb(b, std::ios::binary);
+    if (!fa || !fb) return false;
+    std::vector<char> ba(1<<16), bb(1<<16);
+    for (;;) {
+        fa.read(ba.data(), ba.size());
+        fb.read(bb.data(), bb.size());
+        auto ga = fa.gcount(), gb = fb.gcount();
+        if (fa.bad() || fb.bad() || ga != gb) return false;
+        if (!std::equal(ba.begin(), ba.begin() + ga, bb.begin())) return false;
+        if (fa.eof() || fb.eof()) return fa.eof() && fb.eof();
+    }
+}
+
 // === TXT in-file dedup: keep first occurrence of each line ===
 bool dedupe_txt_inplace(const std::filesystem::path& p) {
     std::ifstream in(p);
@@ -0,0 +1,181 @@
+#include "file_reader.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Crossover measured with sp_dedup_hash_bench --crossover (see bench/).
+    std::atomic<std::uintmax_t> g_mmap_threshold{std::uintmax_t(256) << 10};
+    std::atomic<bool> g_hugepages{false};
+
+    const size_t kReadChunk = 1 << 18;
+
+    std::vector<char>& read_buffer() {
+        thread_local std::vector<char> buf(kReadChunk);
+        return buf;
+    }
+}
+
+void set_mmap_threshold(std::uintmax_t bytes) { g_mmap_threshold = bytes; }
+std::uintmax_t mmap_threshold() { return g_mmap_threshold; }
+void set_mmap_hugepages(bool on) { g_hugepages = on; }
+
+#ifdef _WIN32
+
+void read_file_range(const std::filesystem::path& p, std::uintmax_t offset, std::uintmax_t len,
+                     const std::function<void(const void* data, size_t n)>& sink) {
+    std::ifstream f(p, std::ios::binary);
+    if (!f) throw std::runtime_error("Failed to open file for hashing: " + p.string());
+    if (offset && !f.seekg((std::streamoff)offset)) throw std::runtime_error("Failed to seek for hashing: " + p.string());
+    auto& buf = read_buffer();
+    while (f && len > 0) {
+        f.read(buf.data(), (std::streamsize)std::min<std::uintmax_t>(buf.size(), len));
+        std::streamsize got = f.gcount();
+        if (got>0) {
+            len -= (std::uintmax_t)got;
+            sink(buf.data(), (size_t)got);
+        }
+    }
+    if (f.bad()) throw std::runtime_error("Read failed while hashing: " + p.string());
+}
+
+#else
+
+namespace {
+    struct Fd {
+        int fd;
+        ~Fd() { if (fd >= 0) ::close(fd); }
+    };
+
+    // A file truncated while mapped raises SIGBUS on the pages past its new
+    // end. The handler maps zeros over the rest of the calling thread's
+    // current mapping and flags it, so the sink finishes on zeros and
+    // map_range() then throws as for a failed read. Faults anywhere else go to
+    // the handler that was installed before ours.
+    struct Mapping {
+        char* base;
+        size_t len, page;
+        volatile std::sig_atomic_t truncated;
+    };
+    thread_local Mapping* t_mapping = nullptr;
+    struct sigaction g_prevBus;
+
+    void on_sigbus(int sig, siginfo_t* info, void* ctx) {
+        Mapping* m = t_mapping;
+        char* at = static_cast<char*>(info->si_addr);
+        if (m && at >= m->base && at < m->base + m->len) {
+            char* from = m->base + (size_t)(at - m->base) / m->page * m->page;
+            void* z = ::mmap(from, (size_t)(m->base + m->len - from), PROT_READ,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+            if (z != MAP_FAILED) {
+                m->truncated = 1;
+                return;
+            }
+        }
+        if (g_prevBus.sa_flags & SA_SIGINFO) {
+            g_prevBus.sa_sigaction(sig, info, ctx);
+        } else if (g_prevBus.sa_handler != SIG_DFL && g_prevBus.sa_handler != SIG_IGN) {
+            g_prevBus.sa_handler(sig);
+        } else {
+            ::signal(sig, SIG_DFL);
+            ::raise(sig);
+        }
+    }
+
+    void install_sigbus_handler() {
+        static std::once_flag once;
+        std::call_once(once, [] {
+            struct sigaction sa{};
+            sa.sa_sigaction = on_sigbus;
+            sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+            sigemptyset(&sa.sa_mask);
+            ::sigaction(SIGBUS, &sa, &g_prevBus);
+        });
+    }
+
+    // Returns false if the range could not be mapped; the caller then reads it.
+    bool map_range(const std::filesystem::path& p, int fd, std::uintmax_t offset, std::uintmax_t len,
+                   const std::function<void(const void*, size_t)>& sink) {
+        const std::uintmax_t page = (std::uintmax_t)::sysconf(_SC_PAGESIZE);
+        const std::uintmax_t base = offset - offset % page;
+        const size_t mlen = (size_t)(len + (offset - base));
+        install_sigbus_handler();
+        void* m = ::mmap(nullptr, mlen, PROT_READ, MAP_PRIVATE, fd, (off_t)base);
+        if (m == MAP_FAILED) return false;
+        ::madvise(m, mlen, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        if (g_hugepages) ::madvise(m, mlen, MADV_HUGEPAGE);
+#endif
+        Mapping guard{static_cast<char*>(m), mlen, (size_t)page, 0};
+        Mapping* outer = t_mapping;
+        t_mapping = &guard;
+        try {
+            sink(static_cast<const char*>(m) + (offset - base), (size_t)len);
+        } catch (...) {
+            t_mapping = outer;
+            ::munmap(m, mlen);
+            throw;
+        }
+        t_mapping = outer;
+        ::munmap(m, mlen);
+        if (guard.truncated) throw std::runtime_error("File shrank while hashing: " + p.string());
+        return true;
+    }
+}
+
+void read_file_range(const std::filesystem::path& p, std::uintmax_t offset, std::uintmax_t len,
+                     const std::function<void(const void* data, size_t n)>& sink) {
+    Fd f{::open(p.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (f.fd < 0) throw std::runtime_error("Failed to open file for hashing: " + p.string());
+
+    struct stat st{};
+    const bool regular = ::fstat(f.fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (regular) {
+        const std::uintmax_t size = (std::uintmax_t)st.st_size;
+        if (offset >= size) return;
+        len = std::min(len, size - offset);
+        if (len >= g_mmap_threshold && len <= SIZE_MAX && map_range(p, f.fd, offset, len, sink)) return;
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(f.fd, (off_t)offset, (off_t)len, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    // pread() for regular files; special files (FIFOs, devices) are read
+    // sequentially and the first `offset` bytes are discarded.
+    auto& buf = read_buffer();
+    std::uintmax_t pos = 0;
+    while (len > 0) {
+        std::uintmax_t want = std::min<std::uintmax_t>(buf.size(), pos < offset && !regular ? offset - pos : len);
+        ssize_t got = regular ? ::pread(f.fd, buf.data(), (size_t)want, (off_t)(offset + pos))
+                              : ::read(f.fd, buf.data(), (size_t)want);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Read failed while hashing: " + p.string());
+        }
+        if (got == 0) {
+            // fstat() promised `len` more bytes: the file shrank under us
+            if (regular) throw std::runtime_error("File shrank while hashing: " + p.string());
+            return;     // a special file's end
+        }
+        pos += (std::uintmax_t)got;
+        if (!regular && pos <= offset) continue;   // still skipping
+        sink(buf.data(), (size_t)got);
+        len -= (std::uintmax_t)got;
+    }
+}
+
+#endif
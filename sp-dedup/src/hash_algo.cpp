@@ -0,0 +1,202 @@
+#include "hasher.h"
+#include "file_reader.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <vector>
+#include <stdexcept>
+#include <blake3.h>
+#include <xxhash.h>
+
+namespace {
+    std::string to_hex(const unsigned char* buf, size_t n) {
+        static const char* hex = "0123456789abcdef";
+        std::string out; out.resize(n*2);
+        for (size_t i=0;i<n;++i){ out[2*i]=hex[(buf[i]>>4)&0xF]; out[2*i+1]=hex[buf[i]&0xF]; }
+        return out;
+    }
+
+    // Tree mode (see hasher.h). The chunk size is part of the digest's
+    // definition and must never change.
+    const std::uintmax_t kTreeChunk = std::uintmax_t(16) << 20;
+    std::atomic<std::uintmax_t> g_tree_threshold{std::uintmax_t(1) << 30};
+    std::atomic<unsigned> g_tree_threads{0};
+}
+
+struct HashState::Impl {
+    HashAlgo algo;
+    std::unique_ptr<Sha256Hasher> sha;
+    blake3_hasher b3;
+    XXH3_state_t* xx = nullptr;
+    ~Impl() { if (xx) XXH3_freeState(xx); }
+};
+
+HashState::HashState(HashAlgo a) : impl_(new Impl) {
+    impl_->algo = a;
+    switch (a) {
+        case HashAlgo::Sha256:
+            impl_->sha.reset(new Sha256Hasher);
+            break;
+        case HashAlgo::Blake3:
+            blake3_hasher_init(&impl_->b3);
+            break;
+        case HashAlgo::Xxh3:
+            impl_->xx = XXH3_createState();
+            if (!impl_->xx) throw std::runtime_error("XXH3_createState failed");
+            XXH3_128bits_reset(impl_->xx);
+            break;
+    }
+}
+
+HashState::~HashState() = default;
+
+void HashState::update(const void* data, size_t n) {
+    switch (impl_->algo) {
+        case HashAlgo::Sha256: impl_->sha->update(data, n); break;
+        case HashAlgo::Blake3: blake3_hasher_update(&impl_->b3, data, n); break;
+        case HashAlgo::Xxh3:   XXH3_128bits_update(impl_->xx, data, n); break;
+    }
+}
+
+Digest HashState::finish() {
+    Digest out{};
+    switch (impl_->algo) {
+        case HashAlgo::Sha256:
+            out = impl_->sha->finish();
+            break;
+        case HashAlgo::Blake3:
+            static_assert(BLAKE3_OUT_LEN == std::tuple_size<Digest>::value, "digest width");
+            blake3_hasher_finalize(&impl_->b3, out.data(), out.size());
+            break;
+        case HashAlgo::Xxh3: {
+            XXH128_canonical_t c;
+            XXH128_canonicalFromHash(&c, XXH3_128bits_digest(impl_->xx));
+            std::copy(std::begin(c.digest), std::end(c.digest), out.begin());
+            break;
+        }
+    }
+    return out;
+}
+
+bool parse_hash_algo(const std::string& name, HashAlgo& out) {
+    if (name == "sha256") out = HashAlgo::Sha256;
+    else if (name == "blake3") out = HashAlgo::Blake3;
+    else if (name == "xxh3") out = HashAlgo::Xxh3;
+    else return false;
+    return true;
+}
+
+const char* hash_algo_name(HashAlgo a) {
+    switch (a) {
+        case HashAlgo::Sha256: return "sha256";
+        case HashAlgo::Blake3: return "blake3";
+        case HashAlgo::Xxh3:   return "xxh3";
+    }
+    return "?";
+}
+
+bool hash_algo_is_cryptographic(HashAlgo a) {
+    return a != HashAlgo::Xxh3;
+}
+
+size_t hash_algo_digest_size(HashAlgo a) {
+    return a == HashAlgo::Xxh3 ? 16 : 32;
+}
+
+std::string digest_hex(const Digest& d, HashAlgo a) {
+    return to_hex(d.data(), hash_algo_digest_size(a));
+}
+
+Digest hash_bytes(HashAlgo a, const void* data, size_t n) {
+    Digest out{};
+    switch (a) {
+        case HashAlgo::Sha256:
+            out = sha256(data, n);
+            break;
+        case HashAlgo::Blake3: {
+            blake3_hasher h;
+            blake3_hasher_init(&h);
+            blake3_hasher_update(&h, data, n);
+            blake3_hasher_finalize(&h, out.data(), out.size());
+            break;
+        }
+        case HashAlgo::Xxh3: {
+            XXH128_canonical_t c;
+            XXH128_canonicalFromHash(&c, XXH3_128bits(data, n));
+            std::copy(std::begin(c.digest), std::end(c.digest), out.begin());
+            break;
+        }
+    }
+    return out;
+}
+
+Digest hash_file(const std::filesystem::path& p, HashAlgo a) {
+    if (tree_threshold()) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(p, ec);
+        if (!ec && uses_tree_digest(size)) {
+            unsigned n = g_tree_threads;
+            return hash_file_tree(p, a, n ? n : default_thread_count());
+        }
+    }
+    return hash_file_range(p, a, 0, UINTMAX_MAX);
+}
+
+Digest hash_file_range(const std::filesystem::path& p, HashAlgo a,
+                       std::uintmax_t offset, std::uintmax_t len) {
+    if (a == HashAlgo::Sha256) return sha256_file_range(p, offset, len);
+    HashState st(a);
+    read_file_range(p, offset, len, [&](const void* d, size_t n) { st.update(d, n); });
+    return st.finish();
+}
+
+void set_tree_threshold(std::uintmax_t bytes) { g_tree_threshold = bytes; }
+std::uintmax_t tree_threshold() { return g_tree_threshold; }
+void set_tree_threads(unsigned n) { g_tree_threads = n; }
+
+bool uses_tree_digest(std::uintmax_t size) {
+    std::uintmax_t t = tree_threshold();
+    return t && size > t;
+}
+
+Digest hash_file_tree(const std::filesystem::path& p, HashAlgo a, unsigned threads) {
+    std::error_code ec;
+    const std::uintmax_t size = std::filesystem::file_size(p, ec);
+    if (ec) throw std::runtime_error("Failed to stat file for hashing: " + p.string());
+    const size_t chunks = (size_t)((size + kTreeChunk - 1) / kTreeChunk);
+
+    std::vector<Digest> leaves(chunks);
+    std::atomic<bool> failed{false};
+    parallel_for(chunks, threads, [&](size_t i) {
+        try {
+            HashState st(a);
+            const unsigned char leafTag = 0x00;
+            st.update(&leafTag, 1);
+            read_file_range(p, (std::uintmax_t)i * kTreeChunk, kTreeChunk,
+                            [&](const void* d, size_t n) { st.update(d, n); });
+            leaves[i] = st.finish();
+        } catch (...) {
+            failed = true;
+        }
+    });
+    if (failed) throw std::runtime_error("Read failed while hashing: " + p.string());
+
+    HashState root(a);
+    unsigned char head[9] = {0x01};
+    for (int b = 0; b < 8; ++b) head[1 + b] = (unsigned char)(size >> (8 * b));
+    root.update(head, sizeof(head));
+    const size_t dlen = hash_algo_digest_size(a);
+    for (auto& l : leaves) root.update(l.data(), dlen);
+    return root.finish();
+}
+
+const char* digest_name(HashAlgo a, std::uintmax_t size) {
+    if (!uses_tree_digest(size)) return hash_algo_name(a);
+    switch (a) {
+        case HashAlgo::Sha256: return "sha256-tree";
+        case HashAlgo::Blake3: return "blake3-tree";
+        case HashAlgo::Xxh3:   return "xxh3-tree";
+    }
+    return "?";
+}
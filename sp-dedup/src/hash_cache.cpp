@@ -0,0 +1,137 @@
+#include "hash_cache.h"
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+    const char kMagic[8] = {'S','P','D','C','A','C','H','E'};
+    const std::uint32_t kVersion = 3;   // v2: raw 32-byte digests; v3: prefilter samples
+    const std::uint8_t kTreeBit = 0x80; // in the stored algo byte: tree-mode digest
+
+    template <class T> void put(std::ostream& o, T v) { o.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    template <class T> bool get(std::istream& i, T& v) { return (bool)i.read(reinterpret_cast<char*>(&v), sizeof(v)); }
+}
+
+bool file_stamp(const std::filesystem::path& p, FileStamp& out) {
+#ifdef _WIN32
+    HANDLE h = CreateFileW(p.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    BY_HANDLE_FILE_INFORMATION info{};
+    FILE_BASIC_INFO basic{};
+    bool ok = GetFileInformationByHandle(h, &info) &&
+              GetFileInformationByHandleEx(h, FileBasicInfo, &basic, sizeof(basic));
+    CloseHandle(h);
+    if (!ok) return false;
+    out.dev = info.dwVolumeSerialNumber;
+    out.ino = (std::uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    out.size = (std::uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    out.mtime_ns = basic.LastWriteTime.QuadPart * 100;   // 100ns ticks
+    out.ctime_ns = basic.ChangeTime.QuadPart * 100;
+#else
+    struct stat st{};
+    if (::stat(p.c_str(), &st) != 0) return false;
+    out.dev = (std::uint64_t)st.st_dev;
+    out.ino = (std::uint64_t)st.st_ino;
+    out.size = (std::uint64_t)st.st_size;
+#if defined(__APPLE__)
+    out.mtime_ns = std::int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+    out.ctime_ns = std::int64_t(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    out.mtime_ns = std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    out.ctime_ns = std::int64_t(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+size_t HashCache::KeyHash::operator()(const Key& k) const {
+    // FNV-1a over the key fields
+    std::uint64_t h = 1469598103934665603ull;
+    auto mix = [&](std::uint64_t v) { h ^= v; h *= 1099511628211ull; };
+    mix(k.st.dev); mix(k.st.ino); mix(k.st.size);
+    mix((std::uint64_t)k.st.mtime_ns); mix((std::uint64_t)k.st.ctime_ns); mix((std::uint64_t)k.algo);
+    mix(k.tree); mix(k.part); mix(k.sample);
+    return (size_t)h;
+}
+
+bool HashCache::load(const std::filesystem::path& path) {
+    loaded_.clear();
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return !std::filesystem::exists(path);
+
+    char magic[sizeof(kMagic)];
+    std::uint32_t version = 0;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+        !get(in, version) || (version != kVersion && version != 2)) return false;
+
+    for (;;) {
+        Key k{};
+        std::uint8_t algo = 0;
+        Digest digest;
+        if (!get(in, k.st.dev)) break;   // clean EOF
+        if (!get(in, k.st.ino) || !get(in, k.st.size) || !get(in, k.st.mtime_ns) ||
+            !get(in, k.st.ctime_ns) || !get(in, algo) ||
+            (version >= 3 && (!get(in, k.part) || !get(in, k.sample))) || !get(in, digest)) {
+            loaded_.clear();
+            return false;
+        }
+        k.tree = (algo & kTreeBit) != 0;
+        k.algo = (HashAlgo)(algo & ~kTreeBit);
+        loaded_.emplace(k, digest);
+    }
+    return true;
+}
+
+bool HashCache::save(const std::filesystem::path& path) const {
+    auto tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(kMagic, sizeof(kMagic));
+        put(out, kVersion);
+        for (auto& [k, digest] : live_) {
+            put(out, k.st.dev); put(out, k.st.ino); put(out, k.st.size);
+            put(out, k.st.mtime_ns); put(out, k.st.ctime_ns);
+            put(out, (std::uint8_t)((std::uint8_t)k.algo | (k.tree ? kTreeBit : 0)));
+            put(out, k.part); put(out, k.sample); put(out, digest);
+        }
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+bool HashCache::lookup(const FileStamp& st, HashAlgo algo, Digest& digest) {
+    Key k{st, algo, uses_tree_digest(st.size)};
+    auto it = loaded_.find(k);
+    if (it == loaded_.end()) { ++misses_; return false; }
+    ++hits_;
+    digest = it->second;
+    live_.emplace(k, digest);
+    return true;
+}
+
+void HashCache::store(const FileStamp& st, HashAlgo algo, const Digest& digest) {
+    live_[Key{st, algo, uses_tree_digest(st.size)}] = digest;
+}
+
+bool HashCache::lookup_sample(const FileStamp& st, HashAlgo algo, const PrefilterRound& r, Digest& digest) {
+    Key k{st, algo, false, (std::uint8_t)(1 + r.kind), r.bytes};
+    auto it = loaded_.find(k);
+    if (it == loaded_.end()) return false;
+    digest = it->second;
+    live_.emplace(k, digest);
+    return true;
+}
+
+void HashCache::store_sample(const FileStamp& st, HashAlgo algo, const PrefilterRound& r, const Digest& digest) {
+    live_[Key{st, algo, false, (std::uint8_t)(1 + r.kind), r.bytes}] = digest;
+}
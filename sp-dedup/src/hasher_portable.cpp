@@ -0,0 +1,76 @@
+#include "hasher.h"
+#include "sha256.h"
+#include "file_reader.h"
+
+namespace {
+    std::string to_hex(const unsigned char* buf, size_t n) {
+        static const char* hex = "0123456789abcdef";
+        std::string out; out.resize(n*2);
+        for (size_t i=0;i<n;++i){ out[2*i]=hex[(buf[i]>>4)&0xF]; out[2*i+1]=hex[buf[i]&0xF]; }
+        return out;
+    }
+
+    Digest sha256_range(const std::filesystem::path& p, std::uintmax_t offset, std::uintmax_t len) {
+        Sha256Hasher h;
+        read_file_range(p, offset, len, [&](const void* d, size_t n) { h.update(d, n); });
+        return h.finish();
+    }
+}
+
+struct Sha256Hasher::Impl { Sha256Ctx ctx; };
+
+Sha256Hasher::Sha256Hasher() : impl_(new Impl) { sha256_init(impl_->ctx); }
+Sha256Hasher::~Sha256Hasher() = default;
+
+void Sha256Hasher::update(const void* data, size_t n) { sha256_update(impl_->ctx, data, n); }
+
+Digest Sha256Hasher::finish() {
+    Digest out;
+    sha256_final(impl_->ctx, out.data());
+    sha256_init(impl_->ctx);
+    return out;
+}
+
+void Sha256Hasher::reset() { sha256_init(impl_->ctx); }
+
+Sha256Hasher& thread_sha256() {
+    thread_local Sha256Hasher h;
+    h.reset();
+    return h;
+}
+
+// A stack context costs nothing to set up, so no need for the thread's hasher.
+Digest sha256(const void* data, size_t n) {
+    Sha256Ctx c;
+    sha256_init(c);
+    sha256_update(c, data, n);
+    Digest out;
+    sha256_final(c, out.data());
+    return out;
+}
+
+std::string sha256_hex(const std::string& bytes) {
+    auto d = sha256(bytes.data(), bytes.size());
+    return to_hex(d.data(), d.size());
+}
+
+std::string sha256_hex_file(const std::filesystem::path& p) {
+    auto d = sha256_file(p);
+    return to_hex(d.data(), d.size());
+}
+
+void sha256_batch(const void* const* data, const size_t* len, size_t n, Digest* out) {
+    static_assert(sizeof(Digest) == 32, "digest layout");
+    sha256_many(reinterpret_cast<const unsigned char* const*>(data), len, n,
+                reinterpret_cast<unsigned char (*)[32]>(out));
+}
+
+size_t sha256_batch_lanes() { return sha256_many_lanes(); }
+
+Digest sha256_file(const std::filesystem::path& p) {
+    return sha256_range(p, 0, UINTMAX_MAX);
+}
+
+Digest sha256_file_range(const std::filesystem::path& p, std::uintmax_t offset, std::uintmax_t len) {
+    return sha256_range(p, offset, len);
+}
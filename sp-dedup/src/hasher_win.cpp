@@ -1,95 +1,130 @@
 #include "hasher.h"
+#include "file_reader.h"
 #include <stdexcept>
 #include <vector>
 #include <windows.h>
 #include <bcrypt.h>
-#include <fstream>
+#include <cstdint>
+#include <algorithm>
 
 #pragma comment(lib, "bcrypt.lib")
 
 namespace {
-    std::string to_hex(const std::vector<unsigned char>& buf) {
+    std::string to_hex(const unsigned char* buf, size_t n) {
         static const char* hex = "0123456789abcdef";
-        std::string out; out.resize(buf.size()*2);
-        for (size_t i=0;i<buf.size();++i){ out[2*i]=hex[(buf[i]>>4)&0xF]; out[2*i+1]=hex[buf[i]&0xF]; }
+        std::string out; out.resize(n*2);
+        for (size_t i=0;i<n;++i){ out[2*i]=hex[(buf[i]>>4)&0xF]; out[2*i+1]=hex[buf[i]&0xF]; }
         return out;
     }
 
-    std::string sha256_raw(const unsigned char* data, size_t len) {
-        BCRYPT_ALG_HANDLE hAlg = nullptr;
-        BCRYPT_HASH_HANDLE hHash = nullptr;
-        NTSTATUS s = BCryptOpenAlgorithmProvider(&hAlg, BCRYPT_SHA256_ALGORITHM, nullptr, 0);
-        if (s < 0) throw std::runtime_error("BCryptOpenAlgorithmProvider failed");
-
-        DWORD objLen=0, cb=0;
-        s = BCryptGetProperty(hAlg, BCRYPT_OBJECT_LENGTH, (PUCHAR)&objLen, sizeof(objLen), &cb, 0);
-        if (s < 0) { BCryptCloseAlgorithmProvider(hAlg,0); throw std::runtime_error("Get obj len failed"); }
+    // Opening the provider is most of what CNG costs per tiny message, and the
+    // handle may be shared by every thread, so it is opened once per process.
+    struct Provider {
+        BCRYPT_ALG_HANDLE alg = nullptr;
+        DWORD objLen = 0;
+        Provider() {
+            if (BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA256_ALGORITHM, nullptr, 0) < 0) { alg = nullptr; return; }
+            DWORD cb = 0;
+            if (BCryptGetProperty(alg, BCRYPT_OBJECT_LENGTH, (PUCHAR)&objLen, sizeof(objLen), &cb, 0) < 0) {
+                BCryptCloseAlgorithmProvider(alg,0);
+                alg = nullptr;
+            }
+        }
+        ~Provider() { if (alg) BCryptCloseAlgorithmProvider(alg,0); }
+    };
 
-        DWORD hashLen=0;
-        s = BCryptGetProperty(hAlg, BCRYPT_HASH_LENGTH, (PUCHAR)&hashLen, sizeof(hashLen), &cb, 0);
-        if (s < 0) { BCryptCloseAlgorithmProvider(hAlg,0); throw std::runtime_error("Get hash len failed"); }
+    const Provider& provider() {
+        static const Provider p;
+        if (!p.alg) throw std::runtime_error("BCryptOpenAlgorithmProvider failed");
+        return p;
+    }
+}
 
-        std::vector<BYTE> obj(objLen);
-        std::vector<unsigned char> hash(hashLen);
+Digest sha256(const void* data, size_t n) {
+    auto& h = thread_sha256();
+    h.update(data, n);
+    return h.finish();
+}
 
-        s = BCryptCreateHash(hAlg, &hHash, obj.data(), objLen, nullptr, 0, 0);
-        if (s < 0) { BCryptCloseAlgorithmProvider(hAlg,0); throw std::runtime_error("CreateHash failed"); }
+std::string sha256_hex(const std::string& bytes) {
+    auto d = sha256(bytes.data(), bytes.size());
+    return to_hex(d.data(), d.size());
+}
 
-        if (len) {
-            s = BCryptHashData(hHash, (PUCHAR)data, (ULONG)len, 0);
-            if (s < 0) { BCryptDestroyHash(hHash); BCryptCloseAlgorithmProvider(hAlg,0); throw std::runtime_error("HashData failed"); }
-        }
+// Created with BCRYPT_HASH_REUSABLE_FLAG (Windows 8+): BCryptFinishHash
+// leaves the object ready for the next message.
+struct Sha256Hasher::Impl {
+    BCRYPT_HASH_HANDLE hHash = nullptr;
+    std::vector<BYTE> obj;
+    bool fed = false;           // updated since the last finish
+    ~Impl() { if (hHash) BCryptDestroyHash(hHash); }
+};
+
+Sha256Hasher::Sha256Hasher() : impl_(new Impl) {
+    const Provider& p = provider();
+    impl_->obj.resize(p.objLen);
+    NTSTATUS s = BCryptCreateHash(p.alg, &impl_->hHash, impl_->obj.data(), p.objLen, nullptr, 0,
+                                  BCRYPT_HASH_REUSABLE_FLAG);
+    if (s < 0) throw std::runtime_error("CreateHash failed");
+}
 
-        s = BCryptFinishHash(hHash, hash.data(), (ULONG)hash.size(), 0);
-        BCryptDestroyHash(hHash);
-        BCryptCloseAlgorithmProvider(hAlg,0);
-        if (s < 0) throw std::runtime_error("FinishHash failed");
+Sha256Hasher::~Sha256Hasher() = default;
 
-        return to_hex(hash);
+void Sha256Hasher::update(const void* data, size_t n) {
+    auto p = static_cast<const unsigned char*>(data);
+    impl_->fed = true;
+    while (n) {     // BCryptHashData takes a ULONG length
+        ULONG chunk = (ULONG)std::min<size_t>(n, 1u << 30);
+        if (BCryptHashData(impl_->hHash, (PUCHAR)p, chunk, 0) < 0) throw std::runtime_error("HashData failed");
+        p += chunk; n -= chunk;
     }
 }
 
-std::string sha256_hex(const std::string& bytes) {
-    return sha256_raw(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size());
+Digest Sha256Hasher::finish() {
+    Digest out{};
+    impl_->fed = false;
+    if (BCryptFinishHash(impl_->hHash, out.data(), (ULONG)out.size(), 0) < 0) throw std::runtime_error("FinishHash failed");
+    return out;
+}
+
+// CNG has no reset call; finishing into a scratch digest does the same.
+void Sha256Hasher::reset() {
+    if (impl_->fed) finish();
+}
+
+Sha256Hasher& thread_sha256() {
+    thread_local Sha256Hasher h;
+    h.reset();
+    return h;
+}
+
+namespace {
+    Digest sha256_range(const std::filesystem::path& p, std::uintmax_t offset, std::uintmax_t len) {
+        auto& h = thread_sha256();
+        read_file_range(p, offset, len, [&](const void* d, size_t n) { h.update(d, n); });
+        return h.finish();
+    }
 }
 
 std::string sha256_hex_file(const std::filesystem::path& p) {
-    std::ifstream f(p, std::ios::binary);
-    if (!f) throw std::runtime_error("Failed to open file for hashing: " + p.string());
-    BCRYPT_ALG_HANDLE hAlg = nullptr;
-    BCRYPT_HASH_HANDLE hHash = nullptr;
-    NTSTATUS s = BCryptOpenAlgorithmProvider(&hAlg, BCRYPT_SHA256_ALGORITHM, nullptr, 0);
-    if (s < 0) throw std::runtime_error("BCryptOpenAlgorithmProvider failed");
-
-    DWORD objLen=0, cb=0;
-    s = BCryptGetProperty(hAlg, BCRYPT_OBJECT_LENGTH, (PUCHAR)&objLen, sizeof(objLen), &cb, 0);
-    if (s < 0) { BCryptCloseAlgorithmProvider(hAlg,0); throw std::runtime_error("Get obj len failed"); }
-
-    std::vector<BYTE> obj(objLen);
-    DWORD hashLen=0;
-    s = BCryptGetProperty(hAlg, BCRYPT_HASH_LENGTH, (PUCHAR)&hashLen, sizeof(hashLen), &cb, 0);
-    if (s < 0) { BCryptCloseAlgorithmProvider(hAlg,0); throw std::runtime_error("Get hash len failed"); }
-    std::vector<unsigned char> hash(hashLen);
-
-    s = BCryptCreateHash(hAlg, &hHash, obj.data(), objLen, nullptr, 0, 0);
-    if (s < 0) { BCryptCloseAlgorithmProvider(hAlg,0); throw std::runtime_error("CreateHash failed"); }
-
-    std::vector<char> buf(1<<16);
-    while (f) {
-        f.read(buf.data(), buf.size());
-        std::streamsize got = f.gcount();
-        if (got>0) {
-            s = BCryptHashData(hHash, (PUCHAR)buf.data(), (ULONG)got, 0);
-            if (s < 0) { BCryptDestroyHash(hHash); BCryptCloseAlgorithmProvider(hAlg,0); throw std::runtime_error("HashData failed"); }
-        }
+    auto d = sha256_file(p);
+    return to_hex(d.data(), d.size());
+}
+
+void sha256_batch(const void* const* data, const size_t* len, size_t n, Digest* out) {
+    auto& h = thread_sha256();
+    for (size_t i = 0; i < n; ++i) {
+        h.update(data[i], len[i]);
+        out[i] = h.finish();
     }
-    s = BCryptFinishHash(hHash, hash.data(), (ULONG)hash.size(), 0);
-    BCryptDestroyHash(hHash);
-    BCryptCloseAlgorithmProvider(hAlg,0);
-    if (s < 0) throw std::runtime_error("FinishHash failed");
-    // hex
-    static const char* hex = "0123456789abcdef";
-    std::string out; out.resize(hash.size()*2);
-    for (size_t i=0;i<hash.size();++i){ out[2*i]=hex[(hash[i]>>4)&0xF]; out[2*i+1]=hex[hash[i]&0xF]; }
-    return out;
+}
+
+size_t sha256_batch_lanes() { return 1; }
+
+Digest sha256_file(const std::filesystem::path& p) {
+    return sha256_range(p, 0, UINTMAX_MAX);
+}
+
+Digest sha256_file_range(const std::filesystem::path& p, std::uintmax_t offset, std::uintmax_t len) {
+    return sha256_range(p, offset, len);
 }
@@ -0,0 +1,146 @@
+#include "lockstep.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+
+namespace {
+    const size_t kAlign = 4096;
+
+    struct AlignedDelete {
+        void operator()(char* p) const { ::operator delete[](p, std::align_val_t(kAlign)); }
+    };
+    using Buffer = std::unique_ptr<char[], AlignedDelete>;
+
+    Buffer make_buffer(size_t n) {
+        return Buffer(static_cast<char*>(::operator new[](n, std::align_val_t(kAlign))));
+    }
+
+    struct Member {
+        size_t index;
+        std::ifstream in;
+        Buffer buf;
+        size_t got = 0;
+    };
+
+    // Lockstep pass over at most max_open files.
+    std::vector<std::vector<size_t>> compare_open(const std::vector<std::filesystem::path>& paths,
+                                                  const std::vector<size_t>& idx,
+                                                  std::vector<size_t>& failed,
+                                                  size_t block) {
+        std::vector<std::vector<size_t>> done;
+        std::vector<std::unique_ptr<Member>> open;
+        for (size_t i : idx) {
+            auto m = std::make_unique<Member>();
+            m->index = i;
+            m->in.rdbuf()->pubsetbuf(nullptr, 0);   // reads go straight into our block
+            m->in.open(paths[i], std::ios::binary);
+            if (!m->in) { failed.push_back(i); continue; }
+            m->buf = make_buffer(block);
+            open.push_back(std::move(m));
+        }
+
+        // Live classes: members still equal so far, all at the same offset.
+        std::vector<std::vector<std::unique_ptr<Member>>> live;
+        if (!open.empty()) live.push_back(std::move(open));
+        while (!live.empty()) {
+            std::vector<std::vector<std::unique_ptr<Member>>> next;
+            for (auto& cls : live) {
+                if (cls.size() < 2) {
+                    done.push_back({cls[0]->index});
+                    continue;
+                }
+                bool eof = true;
+                for (auto& m : cls) {
+                    m->in.read(m->buf.get(), (std::streamsize)block);
+                    m->got = (size_t)m->in.gcount();
+                    if (m->in.bad()) m->got = SIZE_MAX;
+                    eof = eof && m->got < block;
+                }
+                // Split by block contents; the first member of each part is its reference.
+                std::vector<std::vector<std::unique_ptr<Member>>> parts;
+                for (auto& m : cls) {
+                    if (m->got == SIZE_MAX) { failed.push_back(m->index); continue; }
+                    auto same = [&](const std::vector<std::unique_ptr<Member>>& p) {
+                        return p[0]->got == m->got && std::memcmp(p[0]->buf.get(), m->buf.get(), m->got) == 0;
+                    };
+                    auto it = std::find_if(parts.begin(), parts.end(), same);
+                    if (it == parts.end()) { parts.emplace_back(); it = parts.end() - 1; }
+                    it->push_back(std::move(m));
+                }
+                for (auto& p : parts) {
+                    if (eof || p.size() < 2) {
+                        std::vector<size_t> c;
+                        for (auto& m : p) c.push_back(m->index);
+                        done.push_back(std::move(c));
+                    } else {
+                        next.push_back(std::move(p));
+                    }
+                }
+            }
+            live.swap(next);
+        }
+        return done;
+    }
+}
+
+std::vector<std::vector<size_t>> lockstep_compare(const std::vector<std::filesystem::path>& paths,
+                                                  std::vector<size_t>& failed,
+                                                  size_t block, size_t budget, size_t max_open) {
+    max_open = std::max<size_t>(2, std::min(max_open, paths.size()));
+    block = std::max(kAlign, std::min(block, budget / max_open) / kAlign * kAlign);
+    std::vector<std::vector<size_t>> classes;
+    if (paths.size() <= max_open) {
+        std::vector<size_t> idx(paths.size());
+        for (size_t i = 0; i < idx.size(); ++i) idx[i] = i;
+        classes = compare_open(paths, idx, failed, block);
+    } else {
+        // Compare batches of max_open/2, then every pair of chunks of the
+        // batches' representatives, joining classes whose representatives match.
+        const size_t half = max_open / 2;
+        std::vector<std::vector<size_t>> parts;
+        for (size_t b = 0; b < paths.size(); b += half) {
+            std::vector<size_t> idx;
+            for (size_t i = b; i < std::min(paths.size(), b + half); ++i) idx.push_back(i);
+            for (auto& c : compare_open(paths, idx, failed, block)) parts.push_back(std::move(c));
+        }
+        std::vector<size_t> root(parts.size());
+        for (size_t r = 0; r < root.size(); ++r) root[r] = r;
+        auto find = [&](size_t r) { while (root[r] != r) r = root[r] = root[root[r]]; return r; };
+        std::vector<size_t> reps;                   // path index of each part's first member
+        std::vector<size_t> partOf(paths.size());
+        for (size_t r = 0; r < parts.size(); ++r) { reps.push_back(parts[r][0]); partOf[parts[r][0]] = r; }
+        std::vector<char> bad(parts.size(), 0);
+        auto join = [&](const std::vector<size_t>& chunk) {
+            std::vector<size_t> idx, lost;
+            for (size_t r : chunk) idx.push_back(reps[r]);
+            for (auto& c : compare_open(paths, idx, lost, block))
+                for (size_t k = 1; k < c.size(); ++k) root[find(partOf[c[k]])] = find(partOf[c[0]]);
+            for (size_t i : lost) bad[partOf[i]] = 1;
+        };
+        std::vector<std::vector<size_t>> chunks;
+        for (size_t r = 0; r < parts.size(); r += half) {
+            chunks.emplace_back();
+            for (size_t k = r; k < std::min(parts.size(), r + half); ++k) chunks.back().push_back(k);
+        }
+        if (chunks.size() == 1) join(chunks[0]);
+        for (size_t a = 0; a < chunks.size(); ++a)
+            for (size_t b = a + 1; b < chunks.size(); ++b) {
+                auto both = chunks[a];
+                both.insert(both.end(), chunks[b].begin(), chunks[b].end());
+                join(both);
+            }
+        std::vector<std::vector<size_t>> merged(parts.size());
+        for (size_t r = 0; r < parts.size(); ++r) {
+            auto& dst = bad[r] ? failed : merged[find(r)];
+            dst.insert(dst.end(), parts[r].begin(), parts[r].end());
+        }
+        for (auto& c : merged) if (!c.empty()) classes.push_back(std::move(c));
+    }
+    for (auto& c : classes) std::sort(c.begin(), c.end());
+    std::sort(classes.begin(), classes.end());
+    std::sort(failed.begin(), failed.end());
+    failed.erase(std::unique(failed.begin(), failed.end()), failed.end());
+    return classes;
+}
@@ -1,33 +1,59 @@
 #include <iostream>
-#include <unordered_map>
+#include <memory>
 #include <unordered_set>
-#include <vector>
 #include <filesystem>
 #include <string>
 #include <optional>
-#include "file_ops.h"
+#include "chunk_store.h"
+#include "dedup_action.h"
 #include "hasher.h"
-#include "docx_dedup.h"
-#include "xlsx_dedup.h"
+#include "session.h"
+#include "watch.h"
+#include "report.h"
+#include "stats.h"
 
 namespace fs = std::filesystem;
 
-struct Args {
+/// Command line: the session's options plus what the client does around it.
+struct Args : ScanOptions {
     fs::path root;
-    bool recurse = false;
-    std::unordered_set<std::string> only_ext;   // e.g. {".docx",".xlsx",".txt"}
-    bool commit = false;        // actually delete / rewrite
     bool within = false;        // Phase-2 in-file dedup
+    bool chunk_analysis = false;            // report sub-file (chunk-level) duplication
+    fs::path store;                         // ingest into this chunk store instead of deduplicating
+    bool watch = false;                     // keep running and dedup files as they change
+    unsigned debounce_ms = 2000;            // --watch: quiet time before a changed file is hashed
+    ReportFormat format = ReportFormat::Text;
+    bool stats = false;                     // print per-stage statistics at the end
+    fs::path stats_file;                    // Prometheus textfile; empty = none
 };
 
 static void usage() {
     std::cout <<
         "Usage:\n"
         "  sp_dedup.exe <directory> [--recurse] [--only-ext=.docx,.xlsx,.txt]\n"
-        "               [--commit] [--within]\n"
+        "               [--commit] [--within] [--action=delete|hardlink|reflink]\n"
+        "               [--prefilter-rounds=N] [--sample-size=BYTES] [--threads=N]\n"
+        "               [--hash=sha256|blake3|xxh3] [--cache=PATH]\n"
+        "               [--mmap-threshold=BYTES] [--hugepages] [--queue-depth=N]\n"
+        "               [--tree-threshold=BYTES]\n"
+        "               [--compare-max=N] [--no-verify]\n"
+        "               [--max-memory=BYTES] [--temp-dir=PATH]\n"
+        "               [--chunk-analysis] [--chunk-size=BYTES] [--chunk-memory=BYTES]\n"
+        "               [--store=DIR] [--compress=0-9]\n"
+        "               [--watch] [--debounce-ms=N] [--format=text|ndjson]\n"
+        "               [--stats] [--stats-file=PATH]\n"
+        "  sp_dedup.exe restore <store> <directory> [--threads=N] [--format=text|ndjson]\n"
         "Examples:\n"
         "  sp_dedup.exe D:\\Documents\\sample_files --recurse --only-ext=.docx,.xlsx,.txt\n"
-        "  sp_dedup.exe D:\\docs --recurse --only-ext=.docx --within --commit\n";
+        "  sp_dedup.exe D:\\docs --recurse --only-ext=.docx --within --commit\n"
+        "  sp_dedup.exe D:\\docs --recurse --store=E:\\archive\n"
+        "  sp_dedup.exe restore E:\\archive D:\\restored\n";
+}
+
+static bool parse_uint(const std::string& s, std::uintmax_t& out) {
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos) return false;
+    try { out = std::stoull(s); } catch (...) { return false; }
+    return true;
 }
 
 static std::optional<Args> parse(int argc, char** argv) {
@@ -48,101 +74,224 @@ static std::optional<Args> parse(int argc, char** argv) {
             }
         } else if (s == "--commit") a.commit = true;
         else if (s == "--within") a.within = true;
+        else if (s == "--no-verify") a.verify = false;
+        else if (s.rfind("--compare-max=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--compare-max=").size()), n)) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+            a.compare_max = (size_t)n;
+        }
+        else if (s.rfind("--action=",0)==0) {
+            if (!parse_dedup_action(s.substr(std::string("--action=").size()), a.action)) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+        }
+        else if (s.rfind("--prefilter-rounds=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--prefilter-rounds=").size()), n)) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+            a.prefilter_rounds = (size_t)n;
+        } else if (s.rfind("--sample-size=",0)==0) {
+            if (!parse_uint(s.substr(std::string("--sample-size=").size()), a.sample_size) || a.sample_size == 0) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+        } else if (s.rfind("--threads=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--threads=").size()), n) || n == 0) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+            a.threads = (unsigned)n;
+        } else if (s.rfind("--hash=",0)==0) {
+            if (!parse_hash_algo(s.substr(std::string("--hash=").size()), a.hash)) {
+                std::cerr << "Unknown hash algorithm: " << s << "\n"; return std::nullopt;
+            }
+        } else if (s.rfind("--cache=",0)==0) {
+            a.cache = fs::path(s.substr(std::string("--cache=").size()));
+        } else if (s.rfind("--mmap-threshold=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--mmap-threshold=").size()), n)) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+            a.mmap_threshold = n;
+        } else if (s == "--hugepages") a.hugepages = true;
+        else if (s.rfind("--tree-threshold=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--tree-threshold=").size()), n)) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+            a.tree_threshold = n;
+        }
+        else if (s.rfind("--queue-depth=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--queue-depth=").size()), n) || n > 1024) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+            a.queue_depth = (unsigned)n;
+        }
+        else if (s.rfind("--max-memory=",0)==0) {
+            if (!parse_uint(s.substr(std::string("--max-memory=").size()), a.max_memory) || a.max_memory < (2u << 20)) {
+                std::cerr << "Bad value: " << s << " (at least 2097152)\n"; return std::nullopt;
+            }
+        } else if (s.rfind("--temp-dir=",0)==0) {
+            a.temp_dir = fs::path(s.substr(std::string("--temp-dir=").size()));
+        } else if (s == "--chunk-analysis") a.chunk_analysis = true;
+        else if (s.rfind("--chunk-size=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--chunk-size=").size()), n) || n < 256 || n > (1u << 20) || (n & (n - 1))) {
+                std::cerr << "Bad value: " << s << " (a power of two, 256 to 1048576)\n"; return std::nullopt;
+            }
+            a.chunk_size = (size_t)n;
+        } else if (s.rfind("--chunk-memory=",0)==0) {
+            if (!parse_uint(s.substr(std::string("--chunk-memory=").size()), a.chunk_memory) || a.chunk_memory < (1u << 20)) {
+                std::cerr << "Bad value: " << s << " (at least 1048576)\n"; return std::nullopt;
+            }
+        } else if (s.rfind("--store=",0)==0) {
+            a.store = fs::path(s.substr(std::string("--store=").size()));
+            if (a.store.empty()) { std::cerr << "Bad value: " << s << "\n"; return std::nullopt; }
+        } else if (s.rfind("--compress=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--compress=").size()), n) || n > 9) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+            a.compress_level = (int)n;
+        } else if (s == "--watch") a.watch = true;
+        else if (s.rfind("--debounce-ms=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--debounce-ms=").size()), n) || n > 3600000) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+            a.debounce_ms = (unsigned)n;
+        }
+        else if (s == "--stats") a.stats = true;
+        else if (s.rfind("--stats-file=",0)==0) {
+            a.stats_file = fs::path(s.substr(std::string("--stats-file=").size()));
+            if (a.stats_file.empty()) { std::cerr << "Bad value: " << s << "\n"; return std::nullopt; }
+        }
+        else if (s.rfind("--format=",0)==0) {
+            if (!parse_report_format(s.substr(std::string("--format=").size()), a.format)) {
+                std::cerr << "Bad value: " << s << "\n"; return std::nullopt;
+            }
+        }
         else { std::cerr << "Unknown arg: " << s << "\n"; usage(); return std::nullopt; }
     }
+    if (a.watch && a.max_memory) {
+        std::cerr << "--watch keeps its index in memory and cannot be combined with --max-memory\n";
+        return std::nullopt;
+    }
+    if (!a.cache.empty() && a.max_memory) {
+        std::cerr << "--cache keeps every entry in memory and cannot be combined with --max-memory\n";
+        return std::nullopt;
+    }
+    if (!a.store.empty() && (a.commit || a.within || a.chunk_analysis || a.watch || a.max_memory)) {
+        std::cerr << "--store only ingests and cannot be combined with --commit, --within, --chunk-analysis,"
+                     " --watch or --max-memory\n";
+        return std::nullopt;
+    }
     return a;
 }
 
+/// `sp_dedup restore <store> <directory>`: every recipe back into a file.
+static int restore_main(int argc, char** argv) {
+    if (argc < 4) { usage(); return 1; }
+    ChunkStoreOptions opt;
+    ReportFormat format = ReportFormat::Text;
+    for (int i=4;i<argc;i++) {
+        std::string s = argv[i];
+        if (s.rfind("--threads=",0)==0) {
+            std::uintmax_t n = 0;
+            if (!parse_uint(s.substr(std::string("--threads=").size()), n) || n == 0) {
+                std::cerr << "Bad value: " << s << "\n"; return 1;
+            }
+            opt.threads = (unsigned)n;
+        } else if (s.rfind("--format=",0)==0) {
+            if (!parse_report_format(s.substr(std::string("--format=").size()), format)) {
+                std::cerr << "Bad value: " << s << "\n"; return 1;
+            }
+        }
+        else { std::cerr << "Unknown arg: " << s << "\n"; usage(); return 1; }
+    }
+    fs::path store = argv[2], target = argv[3];
+    std::error_code ec;
+    if (!fs::is_regular_file(store / "store.cfg", ec)) {
+        std::cerr << "Not a chunk store: " << store << "\n";
+        return 2;
+    }
+
+    BufferedWriter writer(stdout);
+    auto out = make_reporter(format, writer);
+    try {
+        ChunkStore cs(store, opt);
+        return cs.restore(target, *out) ? 0 : 3;
+    } catch (const std::exception& e) {
+        out->error(ReportError::StoreOpen, store, e.what());
+        return 2;
+    }
+}
+
 int main(int argc, char** argv) {
+    if (argc >= 2 && std::string(argv[1]) == "restore") return restore_main(argc, argv);
     auto argsOpt = parse(argc, argv);
     if (!argsOpt) return 1;
     auto args = *argsOpt;
 
-    if (!fs::exists(args.root) || !fs::is_directory(args.root)) {
+    stats_enable(args.stats || !args.stats_file.empty());
+
+    // Reports are formatted by the session and written by the writer's own thread.
+    BufferedWriter writer(stdout);
+    auto out = make_reporter(args.format, writer);
+    DedupSession session(args, *out);
+    if (!session.add_root(args.root)) {
         std::cerr << "Not a directory: " << args.root << "\n";
         return 2;
     }
 
-    // Phase-1: file-level duplicate removal (hash-bytes, group by ext+size+sha256)
-    std::vector<std::string> ext_filter;
-    if (!args.only_ext.empty()) {
-        for (auto& e : args.only_ext) ext_filter.push_back(e);
+    // Archival: every file into the chunk store, nothing deduplicated in place
+    if (!args.store.empty()) {
+        bool ok = session.ingest(args.store);
+        if (args.stats) out->stats(stats_snapshot());
+        if (!args.stats_file.empty() && !write_prometheus_textfile(args.stats_file, stats_snapshot())) {
+            out->error(ReportError::StatsWrite, args.stats_file);
+        }
+        return ok ? 0 : 3;
     }
 
-    auto files = list_target_files(args.root, args.recurse, ext_filter);
-
-    std::unordered_map<std::string, std::vector<fs::path>> buckets; // key=ext|size|sha
-    size_t scanned=0;
+    // Phase-1: file-level duplicate removal (hash-bytes, group by ext+size+digest)
+    if (!session.scan()) return 3;
 
-    for (auto& fi : files) {
-        if (!args.only_ext.empty()) {
-            auto ext = fi.path.extension().string();
-            if (args.only_ext.count(ext)==0) continue;
-        }
-        try {
-            auto h = sha256_hex_file(fi.path);
-            std::string key = fi.path.extension().string() + "|" + std::to_string(fi.size) + "|" + h;
-            buckets[key].push_back(fi.path);
-            ++scanned;
-        } catch (...) {
-            std::cerr << "Failed to hash: " << fi.path << "\n";
-        }
+    // Phase-2: within-file dedup (docx/xlsx/txt)
+    if (args.within) {
+        out->notice("=== Phase-2: Within-file de-duplication ===");
+        session.dedupe_within();
     }
 
-    size_t dupSets=0, removable=0;
-    for (auto& [key, vec] : buckets) {
-        if (vec.size() < 2) continue;
-        ++dupSets;
-        //stable keep-first
-        std::cout << "\nDuplicate set (ext=" << fs::path(vec[0]).extension().string()
-                  << ", size=" << fs::file_size(vec[0])
-                  << ", sha256=" << key.substr(key.rfind('|')+1) << ")\n";
-        for (size_t i=0;i<vec.size();++i) {
-            if (i==0) {
-                std::cout << "  [KEEP] " << vec[i].string() << "\n";
-            } else {
-                std::cout << "  [DEL ] " << vec[i].string() << "\n";
-                if (args.commit) delete_file(vec[i]);
-                ++removable;
-            }
-        }
+    // Shared chunks between files that are not whole duplicates
+    if (args.chunk_analysis) {
+        out->notice("=== Chunk analysis ===");
+        session.analyze_chunks();
     }
 
-    std::cout << "\nScanned files: " << scanned << "\n"
-              << "Duplicate sets: " << dupSets << "\n"
-              << "Files removable: " << removable << "\n";
-
-    // Phase-2: within-file dedup (docx/xlsx/txt)
-    if (args.within) {
-        std::cout << "\n=== Phase-2: Within-file de-duplication ===\n";
-        for (auto& fi : files) {
-            if (!args.only_ext.empty() && args.only_ext.count(fi.path.extension().string())==0) continue;
-
-            std::string report;
-            bool changed = false;
-            try {
-                auto ext = fi.path.extension().string();
-                if (ext == ".docx") {
-                    changed = docx_dedupe_paragraphs_inplace(fi.path, args.commit, report);
-                } else if (ext == ".xlsx") {
-                    changed = xlsx_dedupe_rows_inplace(fi.path, args.commit, report);
-                } else if (ext == ".txt") {
-                    // optional: simple line de-dup (keep first occurrence)
-                    // read, fingerprint lines, rewrite if needed
-                    // (left as-is to keep focus on docx/xlsx)
-                }
-            } catch (const std::exception& e) {
-                report += std::string("  [ERR] ") + e.what() + "\n";
-            }
-            if (!report.empty()) {
-                std::cout << fi.path.string() << "\n" << report;
-                if (changed) std::cout << (args.commit ? "  [WROTE]\n" : "  [WOULD WRITE]\n");
-            }
-        }
+    if (args.stats) out->stats(stats_snapshot());
+    if (!args.stats_file.empty() && !write_prometheus_textfile(args.stats_file, stats_snapshot())) {
+        out->error(ReportError::StatsWrite, args.stats_file);
     }
 
     if (!args.commit) {
-        std::cout << "\nNOTE: dry-run mode. Use --commit to apply deletions/rewrites.\n";
+        out->notice("NOTE: dry-run mode. Use --commit to apply deletions/rewrites.");
+    }
+
+    if (args.watch) {
+        WatchOptions w;
+        w.root = args.root;
+        w.recurse = args.recurse;
+        w.only_ext = args.only_ext;
+        w.hash = args.hash;
+        w.commit = args.commit;
+        w.action = args.action;
+        w.verify = args.verify;
+        w.debounce_ms = args.debounce_ms;
+        return watch_tree(w, session.files(), *out);
     }
     return 0;
 }
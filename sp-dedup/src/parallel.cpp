@@ -0,0 +1,29 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+unsigned default_thread_count() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+void parallel_for(size_t n, unsigned threads, const std::function<void(size_t)>& fn) {
+    if (n == 0) return;
+    size_t workers = std::min<size_t>(std::max(1u, threads), n);
+    if (workers == 1) {
+        for (size_t i = 0; i < n; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i = next++; i < n; i = next++) fn(i);
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (size_t t = 1; t < workers; ++t) pool.emplace_back(work);
+    work();   // calling thread takes a share too
+    for (auto& th : pool) th.join();
+}
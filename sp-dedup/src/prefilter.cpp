@@ -0,0 +1,101 @@
+#include "prefilter.h"
+#include "hasher.h"
+#include "parallel.h"
+#include "stats.h"
+#include <algorithm>
+#include <map>
+
+std::vector<PrefilterRound> make_prefilter_rounds(size_t rounds, std::uintmax_t sample) {
+    std::vector<PrefilterRound> out;
+    if (sample == 0) return out;
+    const PrefilterRound::Kind fixed[] = { PrefilterRound::Head, PrefilterRound::Tail, PrefilterRound::Middle };
+    for (auto k : fixed) {
+        if (out.size() >= rounds) return out;
+        out.push_back({k, sample});
+    }
+    std::uintmax_t prefix = sample;
+    while (out.size() < rounds) {
+        prefix *= 16;
+        out.push_back({PrefilterRound::Prefix, prefix});
+    }
+    return out;
+}
+
+const char* prefilter_round_name(PrefilterRound::Kind k) {
+    switch (k) {
+        case PrefilterRound::Head:   return "head";
+        case PrefilterRound::Tail:   return "tail";
+        case PrefilterRound::Middle: return "middle";
+        case PrefilterRound::Prefix: return "prefix";
+    }
+    return "?";
+}
+
+static std::uintmax_t sample_offset(const PrefilterRound& r, std::uintmax_t size) {
+    switch (r.kind) {
+        case PrefilterRound::Tail:   return size - r.bytes;
+        case PrefilterRound::Middle: return (size - r.bytes) / 2;
+        default:                     return 0;
+    }
+}
+
+std::vector<std::vector<size_t>> prefilter_groups(const std::vector<FileInfo>& files,
+                                                  std::vector<std::vector<size_t>> groups,
+                                                  const std::vector<PrefilterRound>& rounds,
+                                                  HashAlgo algo, unsigned threads,
+                                                  std::vector<PrefilterRoundStats>& stats,
+                                                  std::vector<size_t>& failed,
+                                                  const SampleCache* cache) {
+    for (size_t r = 0; r < rounds.size() && !groups.empty(); ++r) {
+        const auto& rd = rounds[r];
+        auto& st = stats[r];
+
+        // Flatten this round's work; groups too small for the sample pass through.
+        struct Job { size_t group; size_t file; Digest hash; bool ok = false, cached = false; };
+        std::vector<Job> jobs;
+        std::vector<bool> sampled(groups.size(), false);
+        for (size_t g = 0; g < groups.size(); ++g) {
+            if (rd.bytes >= files[groups[g][0]].size) continue;   // full digest covers it
+            sampled[g] = true;
+            for (size_t i : groups[g]) jobs.push_back({g, i, {}});
+        }
+        if (jobs.empty()) continue;
+
+        std::vector<size_t> reads;
+        for (size_t j = 0; j < jobs.size(); ++j) {
+            auto& job = jobs[j];
+            job.cached = job.ok = cache && cache->lookup(job.file, rd, job.hash);
+            if (!job.cached) reads.push_back(j);
+        }
+        parallel_for(reads.size(), threads, [&](size_t k) {
+            auto& job = jobs[reads[k]];
+            const auto& fi = files[job.file];
+            StageItem item(Stage::Prefilter, 1, std::min<std::uintmax_t>(rd.bytes, fi.size));
+            try {
+                job.hash = hash_file_range(fi.path, algo, sample_offset(rd, fi.size), rd.bytes);
+                job.ok = true;
+            } catch (...) {}
+        });
+        if (cache) {
+            for (size_t j : reads) if (jobs[j].ok) cache->store(jobs[j].file, rd, jobs[j].hash);
+        }
+
+        std::vector<std::vector<size_t>> next;
+        size_t j = 0;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            if (!sampled[g]) { next.push_back(std::move(groups[g])); continue; }
+            std::map<Digest, std::vector<size_t>> split;   // ordered: stable output
+            for (; j < jobs.size() && jobs[j].group == g; ++j) {
+                if (!jobs[j].ok) { failed.push_back(jobs[j].file); continue; }
+                split[jobs[j].hash].push_back(jobs[j].file);
+                ++(jobs[j].cached ? st.cached : st.sampled);
+            }
+            for (auto& [h, sub] : split) {
+                if (sub.size() < 2) st.eliminated += sub.size();
+                else next.push_back(std::move(sub));
+            }
+        }
+        groups.swap(next);
+    }
+    return groups;
+}
@@ -0,0 +1,467 @@
+#include "report.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+BufferedWriter::BufferedWriter(std::FILE* out, size_t capacity)
+    : out_(out), capacity_(capacity ? capacity : 1) {
+    fill_.reserve(capacity_);
+    drain_.reserve(capacity_);
+    thread_ = std::thread([this] { run(); });
+}
+
+BufferedWriter::~BufferedWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    work_.notify_one();
+    thread_.join();
+}
+
+// Swap the full buffer to the thread once it is done with the previous one.
+void BufferedWriter::hand_off(std::unique_lock<std::mutex>& lock) {
+    idle_.wait(lock, [&] { return !draining_; });
+    if (fill_.empty()) return;
+    fill_.swap(drain_);
+    draining_ = true;
+    work_.notify_one();
+}
+
+void BufferedWriter::write(const char* data, size_t n) {
+    std::unique_lock<std::mutex> lock(mu_);
+    fill_.append(data, n);
+    if (fill_.size() >= capacity_) hand_off(lock);
+}
+
+void BufferedWriter::flush() {
+    std::unique_lock<std::mutex> lock(mu_);
+    hand_off(lock);
+    idle_.wait(lock, [&] { return !draining_; });
+}
+
+void BufferedWriter::run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+        work_.wait(lock, [&] { return draining_ || stop_; });
+        if (!draining_) return;
+        lock.unlock();
+        std::fwrite(drain_.data(), 1, drain_.size(), out_);
+        std::fflush(out_);
+        lock.lock();
+        drain_.clear();
+        draining_ = false;
+        idle_.notify_all();
+    }
+}
+
+bool parse_report_format(const std::string& name, ReportFormat& out) {
+    if (name == "text") { out = ReportFormat::Text; return true; }
+    if (name == "ndjson") { out = ReportFormat::Ndjson; return true; }
+    return false;
+}
+
+namespace {
+    // 850ns, 12.4us, 3.1ms, 2.05s
+    std::string human_ns(std::uint64_t ns) {
+        char buf[32];
+        if (ns < 1000) std::snprintf(buf, sizeof(buf), "%lluns", (unsigned long long)ns);
+        else if (ns < 1000000) std::snprintf(buf, sizeof(buf), "%.3gus", ns / 1e3);
+        else if (ns < 1000000000) std::snprintf(buf, sizeof(buf), "%.3gms", ns / 1e6);
+        else std::snprintf(buf, sizeof(buf), "%.3gs", ns / 1e9);
+        return buf;
+    }
+
+    // "95.0%"; 0 of 0 is 0%
+    std::string percent(std::uint64_t part, std::uint64_t whole) {
+        char buf[16];
+        std::snprintf(buf, sizeof(buf), "%.1f%%", whole ? 100.0 * (double)std::min(part, whole) / (double)whole : 0.0);
+        return buf;
+    }
+
+    // "1.84 GB/s" (decimal: bytes per nanosecond)
+    std::string gb_per_s(std::uint64_t bytes, std::uint64_t ns) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.2f GB/s", ns ? (double)bytes / (double)ns : 0.0);
+        return buf;
+    }
+
+    const char* action_tag(DedupAction a) {
+        return a == DedupAction::Delete ? "[DEL ]" : a == DedupAction::Hardlink ? "[LINK]" : "[REFL]";
+    }
+
+    class TextReporter : public Reporter {
+    public:
+        explicit TextReporter(BufferedWriter& out) : out_(out) {}
+
+        void hard_links(const std::string& ext, std::uint64_t size,
+                        const std::vector<fs::path>& paths) override {
+            std::string s = "\nAlready deduplicated (ext=" + ext + ", size=" + std::to_string(size) +
+                            ", " + std::to_string(paths.size()) + " hard links)\n";
+            for (auto& p : paths) s += "  [HLNK] " + p.string() + "\n";
+            out_.write(s);
+        }
+
+        void duplicate_set(const DuplicateSetRecord& set) override {
+            std::string s = "\nDuplicate set (ext=" + set.ext + ", size=" + std::to_string(set.size) + ", ";
+            s += set.algo ? std::string(set.algo) + "=" + set.digest + ")\n" : "byte-compared)\n";
+            for (auto& m : set.members) {
+                const char* note = m.same_inode ? " (same inode)" : "";
+                switch (m.role) {
+                    case SetMember::Keep:    s += "  [KEEP] " + m.path.string() + note + "\n"; break;
+                    case SetMember::Acted:   s += std::string("  ") + action_tag(set.action) + " " + m.path.string() + note + "\n"; break;
+                    case SetMember::Skipped: s += "  [SKIP] " + m.path.string() + " (" + m.detail + ")\n"; break;
+                    case SetMember::Failed:
+                        s += "  [FAIL] " + m.path.string() + note;
+                        if (!m.detail.empty()) s += " (" + m.detail + ")";
+                        s += "\n";
+                        break;
+                }
+            }
+            out_.write(s);
+        }
+
+        void within_file(const fs::path& path, const std::string& report, bool changed, bool committed) override {
+            std::string s = path.string() + "\n" + report;
+            if (changed) s += committed ? "  [WROTE]\n" : "  [WOULD WRITE]\n";
+            out_.write(s);
+        }
+
+        // Errors stay unbuffered on stderr, as before.
+        void error(ReportError kind, const fs::path& path, const std::string& detail) override {
+            std::ostringstream s;
+            switch (kind) {
+                case ReportError::Hash:            s << "Failed to hash: "; break;
+                case ReportError::Read:            s << "Failed to read: "; break;
+                case ReportError::DigestCollision: s << "Equal " << detail << " digest but different content: "; break;
+                case ReportError::CacheRead:       s << "Ignoring unreadable hash cache: "; break;
+                case ReportError::CacheWrite:      s << "Failed to write hash cache: "; break;
+                case ReportError::SortRuns:        s << "Failed to write sort runs in "; break;
+                case ReportError::StatsWrite:      s << "Failed to write stats file: "; break;
+                case ReportError::StoreOpen:       s << "Cannot use chunk store "; break;
+                case ReportError::StoreWrite:      s << "Failed to store: "; break;
+                case ReportError::Restore:         s << "Failed to restore: "; break;
+                case ReportError::Watch:           s << "Watch failed on "; break;
+                case ReportError::WatchDir:        s << "Cannot watch "; break;
+                case ReportError::WatchOverflow:   s << "inotify queue overflowed; re-indexing "; break;
+            }
+            s << std::quoted(path.string());
+            if (!detail.empty() && kind != ReportError::DigestCollision) s << " (" << detail << ")";
+            s << "\n";
+            std::cerr << s.str();
+        }
+
+        void summary(const SummaryRecord& st) override {
+            std::ostringstream s;
+            s << "\nScanned files: " << st.scanned << "\n"
+              << "Skipped (unique size): " << st.skipped_files << " files, " << st.skipped_bytes << " bytes\n"
+              << "Skipped (hard link to a scanned file): " << st.linked_paths << " files\n"
+              << "Hashed files: " << st.hashed << "\n"
+              << "Compared files: " << st.compared << "\n";
+            for (size_t r=0;r<st.rounds.size();++r) {
+                auto& rd = st.rounds[r];
+                s << "Prefilter round " << (r+1) << " (" << rd.kind << " " << rd.bytes << " bytes): sampled "
+                  << rd.sampled;
+                if (rd.cached) s << ", cached " << rd.cached;
+                s << ", eliminated " << rd.eliminated << "\n";
+            }
+            if (st.cache) s << "Hash cache: " << st.cache->first << " hits, " << st.cache->second << " misses\n";
+            if (st.sort_runs) s << "Sort runs: " << *st.sort_runs << "\n";
+            s << "Duplicate sets: " << st.dup_sets << "\n"
+              << (st.action == DedupAction::Delete ? "Files removable: " : "Files shareable: ") << st.removable << "\n";
+            if (st.failed_actions) s << "Failed " << dedup_action_name(st.action) << ": " << st.failed_actions << " files\n";
+            out_.write(s.str());
+        }
+
+        void chunk_pair(const ChunkPairRecord& p) override {
+            out_.write("\nShared chunks (" + std::to_string(p.shared) + " of " + std::to_string(p.second_size) +
+                       " bytes, " + percent(p.shared, p.second_size) + ")\n" +
+                       "  [ORIG] " + p.first.string() + "\n  [COPY] " + p.second.string() + "\n");
+        }
+        void chunk_dir(const ChunkDirRecord& d) override {
+            out_.write(std::string(chunkDirs_++ ? "" : "\n") + "Chunks in " + d.dir.string() + ": " +
+                       std::to_string(d.files) + " files, " + std::to_string(d.reclaimable) + " of " + std::to_string(d.bytes) + " bytes reclaimable (" +
+                       percent(d.reclaimable, d.bytes) + ")\n");
+        }
+        void chunk_summary(const ChunkSummaryRecord& st) override {
+            std::ostringstream s;
+            s << "\nChunked files: " << st.files << "\n"
+              << "Chunked bytes: " << st.bytes << " in " << st.chunks << " chunks (average target "
+              << st.avg_chunk << " bytes)\n"
+              << "Reclaimable at chunk level: " << st.reclaimable << " bytes (" << percent(st.reclaimable, st.bytes)
+              << "), " << st.within_files << " within single files\n"
+              << "File pairs sharing chunks: " << st.pairs << " (" << st.pairs_listed << " listed)\n";
+            if (st.unlisted_pair_bytes) s << "Shared bytes in pairs beyond the pair table: " << st.unlisted_pair_bytes << "\n";
+            s << "Chunk index: " << st.index_bytes << " of " << st.budget << " bytes";
+            if (st.sample_shift) s << "; sampled 1 in " << (std::uint64_t(1) << st.sample_shift) << " chunks, figures are estimates";
+            s << "\n";
+            out_.write(s.str());
+        }
+        void store_summary(const StoreSummaryRecord& st) override {
+            std::ostringstream s;
+            s << "\nStored files: " << st.files << " (" << st.failed << " failed)\n"
+              << "Stored bytes: " << st.bytes << " in " << st.chunks << " chunks\n"
+              << "New chunks: " << st.new_chunks << ", " << st.new_bytes << " bytes, " << st.stored_bytes
+              << " bytes in " << st.segments << " new segments\n"
+              << "Ingest: " << gb_per_s(st.bytes, st.wall_ns) << " (" << human_ns(st.wall_ns) << ") into "
+              << st.store.string() << "\n";
+            out_.write(s.str());
+        }
+        void restore_summary(const RestoreSummaryRecord& st) override {
+            std::ostringstream s;
+            s << "\nRestored files: " << st.files << " (" << st.failed << " failed), " << st.bytes << " bytes\n"
+              << "Restore: " << gb_per_s(st.bytes, st.wall_ns) << " (" << human_ns(st.wall_ns) << ") into "
+              << st.target.string() << "\n";
+            out_.write(s.str());
+        }
+        // A table of the stages, then each stage's non-empty latency buckets.
+        void stats(const std::vector<StageStats>& stages) override {
+            char line[160];
+            std::string s = "\n=== Stage statistics ===\n";
+            std::snprintf(line, sizeof(line), "%-11s %10s %15s %11s %11s %9s %9s %9s\n",
+                          "stage", "files", "bytes", "wall ms", "cpu ms", "items", "p50 <=", "p99 <=");
+            s += line;
+            for (auto& st : stages) {
+                std::string p50 = st.items ? human_ns(stats_quantile_ns(st, 0.5)) : "-";
+                std::string p99 = st.items ? human_ns(stats_quantile_ns(st, 0.99)) : "-";
+                std::snprintf(line, sizeof(line), "%-11s %10llu %15llu %11.1f %11.1f %9llu %9s %9s\n",
+                              stage_name(st.stage), (unsigned long long)st.files, (unsigned long long)st.bytes,
+                              st.wall_ns / 1e6, st.cpu_ns / 1e6, (unsigned long long)st.items,
+                              p50.c_str(), p99.c_str());
+                s += line;
+            }
+            for (auto& st : stages) {
+                if (!st.items) continue;
+                s += std::string("Latency ") + stage_name(st.stage) + ":";
+                for (size_t b = 0; b < kLatencyBuckets; ++b) {
+                    if (!st.hist[b]) continue;
+                    s += " <" + human_ns(b ? std::uint64_t(1) << b : 1) + " " + std::to_string(st.hist[b]) + ",";
+                }
+                s.back() = '\n';
+            }
+            out_.write(s);
+        }
+
+        void notice(const std::string& text) override { out_.write("\n" + text + "\n"); }
+
+        void flush() override { out_.flush(); }
+
+    private:
+        BufferedWriter& out_;
+        size_t chunkDirs_ = 0;                  // a blank line goes before the first
+    };
+
+    // Appends one JSON object, field by field, to a line buffer.
+    class JsonLine {
+    public:
+        JsonLine() = default;
+        explicit JsonLine(const char* type) { str("type", type); }
+
+        JsonLine& str(const char* k, const std::string& v) { key(k); quote(v); return *this; }
+        JsonLine& num(const char* k, std::uint64_t v) { key(k); s_ += std::to_string(v); return *this; }
+        JsonLine& boolean(const char* k, bool v) { key(k); s_ += v ? "true" : "false"; return *this; }
+        JsonLine& null(const char* k) { key(k); s_ += "null"; return *this; }
+        /// `json` must already be a complete JSON value.
+        JsonLine& raw(const char* k, const std::string& json) { key(k); s_ += json; return *this; }
+
+        std::string line() const { return s_ + "}\n"; }
+
+        static std::string quoted(const std::string& v) { JsonLine j; j.quote(v); return j.s_.substr(1); }
+
+    private:
+        void key(const char* k) {
+            s_ += first_ ? "" : ",";
+            first_ = false;
+            quote(k);
+            s_ += ':';
+        }
+
+        // Control characters, quotes and backslashes are escaped; other bytes
+        // (UTF-8 paths) pass through.
+        void quote(const std::string& v) {
+            static const char hex[] = "0123456789abcdef";
+            s_ += '"';
+            for (unsigned char c : v) {
+                switch (c) {
+                    case '"':  s_ += "\\\""; break;
+                    case '\\': s_ += "\\\\"; break;
+                    case '\n': s_ += "\\n"; break;
+                    case '\r': s_ += "\\r"; break;
+                    case '\t': s_ += "\\t"; break;
+                    default:
+                        if (c < 0x20) { s_ += "\\u00"; s_ += hex[c >> 4]; s_ += hex[c & 15]; }
+                        else s_ += (char)c;
+                }
+            }
+            s_ += '"';
+        }
+
+        std::string s_ = "{";
+        bool first_ = true;
+    };
+
+    std::string json_path(const fs::path& p) { return JsonLine::quoted(p.u8string()); }
+
+    class NdjsonReporter : public Reporter {
+    public:
+        explicit NdjsonReporter(BufferedWriter& out) : out_(out) {}
+
+        void hard_links(const std::string& ext, std::uint64_t size,
+                        const std::vector<fs::path>& paths) override {
+            std::string list = "[";
+            for (size_t i=0;i<paths.size();++i) list += (i ? "," : "") + json_path(paths[i]);
+            list += "]";
+            out_.write(JsonLine("hard_links").str("ext", ext).num("size", size).raw("paths", list).line());
+        }
+
+        void duplicate_set(const DuplicateSetRecord& set) override {
+            std::string list = "[";
+            for (size_t i=0;i<set.members.size();++i) {
+                auto& m = set.members[i];
+                list += i ? ",{" : "{";
+                list += "\"path\":" + json_path(m.path) + ",\"role\":\"";
+                switch (m.role) {
+                    case SetMember::Keep:    list += "keep"; break;
+                    case SetMember::Acted:   list += dedup_action_name(set.action); break;
+                    case SetMember::Skipped: list += "skip"; break;
+                    case SetMember::Failed:  list += "fail"; break;
+                }
+                list += "\"";
+                if (m.same_inode) list += ",\"same_inode\":true";
+                if (!m.detail.empty()) list += ",\"reason\":" + JsonLine::quoted(m.detail);
+                list += "}";
+            }
+            list += "]";
+            JsonLine j("duplicate_set");
+            j.str("ext", set.ext).num("size", set.size);
+            if (set.algo) j.str("algo", set.algo).str("digest", set.digest);
+            else j.null("algo").null("digest");
+            out_.write(j.raw("files", list).line());
+        }
+
+        void within_file(const fs::path& path, const std::string& report, bool changed, bool committed) override {
+            // The deduper's report is indented lines; keep them as an array.
+            std::string lines = "[";
+            std::istringstream in(report);
+            bool first = true;
+            for (std::string l; std::getline(in, l); ) {
+                auto b = l.find_first_not_of(' ');
+                if (b == std::string::npos) continue;
+                lines += (first ? "" : ",") + JsonLine::quoted(l.substr(b));
+                first = false;
+            }
+            lines += "]";
+            out_.write(JsonLine("within_file").raw("path", json_path(path)).boolean("changed", changed)
+                           .boolean("written", changed && committed).raw("report", lines).line());
+        }
+
+        void error(ReportError kind, const fs::path& path, const std::string& detail) override {
+            const char* code = "";
+            switch (kind) {
+                case ReportError::Hash:            code = "hash_failed"; break;
+                case ReportError::Read:            code = "read_failed"; break;
+                case ReportError::DigestCollision: code = "digest_collision"; break;
+                case ReportError::CacheRead:       code = "cache_unreadable"; break;
+                case ReportError::CacheWrite:      code = "cache_write_failed"; break;
+                case ReportError::SortRuns:        code = "sort_runs_failed"; break;
+                case ReportError::StatsWrite:      code = "stats_write_failed"; break;
+                case ReportError::StoreOpen:       code = "store_unusable"; break;
+                case ReportError::StoreWrite:      code = "store_write_failed"; break;
+                case ReportError::Restore:         code = "restore_failed"; break;
+                case ReportError::Watch:           code = "watch_failed"; break;
+                case ReportError::WatchDir:        code = "watch_dir_failed"; break;
+                case ReportError::WatchOverflow:   code = "watch_overflow"; break;
+            }
+            JsonLine j("error");
+            j.str("error", code).raw("path", json_path(path));
+            if (!detail.empty()) j.str("detail", detail);
+            out_.write(j.line());
+        }
+
+        void summary(const SummaryRecord& st) override {
+            std::string rounds = "[";
+            for (size_t r=0;r<st.rounds.size();++r) {
+                auto& rd = st.rounds[r];
+                rounds += (r ? "," : "") + JsonLine().str("kind", rd.kind).num("bytes", rd.bytes)
+                              .num("sampled", rd.sampled).num("cached", rd.cached)
+                              .num("eliminated", rd.eliminated).line();
+                rounds.pop_back();      // line()'s newline
+            }
+            rounds += "]";
+            JsonLine j("summary");
+            j.num("scanned", st.scanned).num("skipped_files", st.skipped_files).num("skipped_bytes", st.skipped_bytes)
+             .num("linked_paths", st.linked_paths).num("hashed", st.hashed).num("compared", st.compared)
+             .raw("prefilter", rounds);
+            if (st.cache) j.num("cache_hits", st.cache->first).num("cache_misses", st.cache->second);
+            if (st.sort_runs) j.num("sort_runs", *st.sort_runs);
+            j.num("duplicate_sets", st.dup_sets).str("action", dedup_action_name(st.action))
+             .num("files", st.removable).num("failed", st.failed_actions);
+            out_.write(j.line());
+        }
+
+        void chunk_pair(const ChunkPairRecord& p) override {
+            out_.write(JsonLine("chunk_pair").raw("first", json_path(p.first)).raw("second", json_path(p.second))
+                           .num("shared", p.shared).num("second_size", p.second_size).line());
+        }
+        void chunk_dir(const ChunkDirRecord& d) override {
+            out_.write(JsonLine("chunk_dir").raw("dir", json_path(d.dir)).num("files", d.files)
+                           .num("bytes", d.bytes).num("reclaimable", d.reclaimable).line());
+        }
+        void chunk_summary(const ChunkSummaryRecord& st) override {
+            out_.write(JsonLine("chunk_summary").num("files", st.files).num("bytes", st.bytes).num("chunks", st.chunks)
+                           .num("avg_chunk", st.avg_chunk).num("reclaimable", st.reclaimable)
+                           .num("within_files", st.within_files).num("pairs", st.pairs)
+                           .num("pairs_listed", st.pairs_listed).num("unlisted_pair_bytes", st.unlisted_pair_bytes)
+                           .num("index_bytes", st.index_bytes).num("budget", st.budget)
+                           .num("sample_shift", st.sample_shift).line());
+        }
+        void store_summary(const StoreSummaryRecord& st) override {
+            out_.write(JsonLine("store_summary").raw("store", json_path(st.store)).num("files", st.files)
+                           .num("failed", st.failed).num("bytes", st.bytes).num("chunks", st.chunks)
+                           .num("new_chunks", st.new_chunks).num("new_bytes", st.new_bytes)
+                           .num("stored_bytes", st.stored_bytes).num("segments", st.segments)
+                           .num("wall_ns", st.wall_ns).line());
+        }
+        void restore_summary(const RestoreSummaryRecord& st) override {
+            out_.write(JsonLine("restore_summary").raw("store", json_path(st.store)).raw("target", json_path(st.target))
+                           .num("files", st.files).num("failed", st.failed).num("bytes", st.bytes)
+                           .num("wall_ns", st.wall_ns).line());
+        }
+        void stats(const std::vector<StageStats>& stages) override {
+            std::string list = "[";
+            for (size_t i=0;i<stages.size();++i) {
+                auto& st = stages[i];
+                // [upper bound ns, count] for each non-empty log2 bucket
+                std::string hist = "[";
+                for (size_t b = 0; b < kLatencyBuckets; ++b) {
+                    if (!st.hist[b]) continue;
+                    if (hist.size() > 1) hist += ",";
+                    hist += "[" + std::to_string(b ? std::uint64_t(1) << b : 1) + "," + std::to_string(st.hist[b]) + "]";
+                }
+                hist += "]";
+                list += (i ? "," : "") + JsonLine().str("stage", stage_name(st.stage)).num("files", st.files)
+                            .num("bytes", st.bytes).num("wall_ns", st.wall_ns).num("cpu_ns", st.cpu_ns)
+                            .num("items", st.items).num("latency_ns", st.latency_ns).raw("latency_hist", hist).line();
+                list.pop_back();
+            }
+            list += "]";
+            out_.write(JsonLine("stats").raw("stages", list).line());
+        }
+
+        void notice(const std::string& text) override { out_.write(JsonLine("notice").str("message", text).line()); }
+
+        void flush() override { out_.flush(); }
+
+    private:
+        BufferedWriter& out_;
+    };
+}
+
+std::unique_ptr<Reporter> make_reporter(ReportFormat format, BufferedWriter& out) {
+    if (format == ReportFormat::Ndjson) return std::make_unique<NdjsonReporter>(out);
+    return std::make_unique<TextReporter>(out);
+}
@@ -0,0 +1,693 @@
+#include "session.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <set>
+#include <unordered_map>
+#include "async_hash.h"
+#include "chunk_analysis.h"
+#include "chunk_store.h"
+#include "docx_dedup.h"
+#include "external_sort.h"
+#include "file_reader.h"
+#include "hash_cache.h"
+#include "lockstep.h"
+#include "prefilter.h"
+#include "stats.h"
+#include "xlsx_dedup.h"
+
+namespace fs = std::filesystem;
+
+/// Phase-1 bucket key: everything two files must share to be reported as duplicates.
+struct BucketKey {
+    std::uint64_t size;
+    std::uint32_t ext;          // index into the interned extension table
+    std::uint32_t algo;         // HashAlgo
+    Digest digest;
+    bool operator==(const BucketKey& o) const {
+        return size == o.size && ext == o.ext && algo == o.algo && digest == o.digest;
+    }
+};
+
+struct BucketKeyHash {
+    size_t operator()(const BucketKey& k) const {
+        // digest bytes are already uniformly distributed
+        std::uint64_t h;
+        std::memcpy(&h, k.digest.data(), sizeof(h));
+        return (size_t)(h ^ (k.size * 0x9E3779B97F4A7C15ull) ^ k.ext);
+    }
+};
+
+using Bucket = std::pair<const BucketKey, std::vector<std::uint32_t>>;
+
+/// Phase-1 state shared by every batch of files: options, interned extensions,
+/// prefilter schedule, hash cache and report totals.
+struct Phase1 {
+    const ScanOptions& args;
+    Reporter& out;
+    std::vector<std::string> extNames;
+    std::unordered_map<std::string, std::uint32_t> extIds;
+    std::vector<PrefilterRound> rounds;
+    std::vector<PrefilterRoundStats> roundStats;
+    HashCache cache;
+    size_t scanned=0, skippedFiles=0, linkedPaths=0, hashed=0, comparedFiles=0;
+    std::uintmax_t skippedBytes=0;
+    size_t dupSets=0, removable=0, failedActions=0;
+};
+
+/// Phase-1 for one batch of files: group by (ext, size), settle each group from
+/// the cache, the prefilter, a lockstep comparison or full digests, then report
+/// and act on the duplicate sets. A batch must hold every path of each size it
+/// contains. Groups are reported in (ext, size, listing order).
+static void process_batch(Phase1& ph, const std::vector<FileInfo>& files) {
+    const ScanOptions& args = ph.args;
+    Reporter& out = ph.out;
+
+    // Extensions are interned once; groups and bucket keys carry a small id.
+    std::vector<std::uint32_t> extOf(files.size());
+    std::vector<std::uint32_t> eligible;
+    for (size_t i=0;i<files.size();++i) {
+        auto ext = files[i].path.extension().string();
+        if (!args.only_ext.empty() && args.only_ext.count(ext)==0) continue;
+        auto [it, added] = ph.extIds.emplace(ext, (std::uint32_t)ph.extNames.size());
+        if (added) ph.extNames.push_back(ext);
+        extOf[i] = it->second;
+        eligible.push_back((std::uint32_t)i);
+    }
+    ph.scanned += eligible.size();
+
+    // Hard links: paths sharing an inode are one file on disk. Only the first
+    // (in listing order) is grouped and read; the others follow it through every
+    // action and are reported as already deduplicated.
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> aliases;   // first path -> other paths
+    {
+        std::map<std::pair<std::uint64_t, std::uint64_t>, std::uint32_t> firstPath;
+        std::vector<std::uint32_t> kept;
+        for (auto i : eligible) {
+            auto& fi = files[i];
+            if (has_inode(fi)) {
+                auto [it, added] = firstPath.emplace(std::make_pair(fi.dev, fi.ino), i);
+                if (!added) {
+                    aliases[it->second].push_back(i);
+                    ++ph.linkedPaths;
+                    continue;
+                }
+            }
+            kept.push_back(i);
+        }
+        eligible.swap(kept);
+    }
+    std::vector<std::uint32_t> extRank(ph.extNames.size());   // id -> position in name order
+    {
+        std::vector<std::uint32_t> byName(ph.extNames.size());
+        std::iota(byName.begin(), byName.end(), 0u);
+        std::sort(byName.begin(), byName.end(), [&](auto x, auto y) { return ph.extNames[x] < ph.extNames[y]; });
+        for (std::uint32_t r=0;r<byName.size();++r) extRank[byName[r]] = r;
+    }
+    // (ext, size, listing order): the order groups are processed and reported in
+    auto groupLess = [&](size_t x, size_t y) {
+        if (extOf[x] != extOf[y]) return extRank[extOf[x]] < extRank[extOf[y]];
+        if (files[x].size != files[y].size) return files[x].size < files[y].size;
+        return x < y;
+    };
+
+    // Size-first elimination: a file alone in its (ext,size) group cannot have a
+    // duplicate, so it is never opened. Only groups with 2+ members are hashed.
+    std::sort(eligible.begin(), eligible.end(), groupLess);
+    std::vector<std::vector<size_t>> candidates;
+    for (size_t b=0, e=0; b<eligible.size(); b=e) {
+        for (e=b+1; e<eligible.size() && extOf[eligible[e]]==extOf[eligible[b]] &&
+                    files[eligible[e]].size==files[eligible[b]].size; ++e) {}
+        if (e-b < 2) {
+            ++ph.skippedFiles;
+            ph.skippedBytes += files[eligible[b]].size;
+        } else {
+            candidates.emplace_back(eligible.begin()+b, eligible.begin()+e);
+        }
+    }
+    std::vector<std::uint32_t>().swap(eligible);
+
+    // Cache lookups: a group whose members all hit is settled without reading.
+    std::unordered_map<size_t, FileStamp> stamps;       // file index -> stat at lookup time
+    std::unordered_map<size_t, Digest> cached;          // file index -> cached digest
+    if (!args.cache.empty()) {
+        std::vector<size_t> idx;
+        for (auto& g : candidates) idx.insert(idx.end(), g.begin(), g.end());
+        std::vector<std::optional<FileStamp>> st(idx.size());
+        parallel_for(idx.size(), args.threads, [&](size_t j) {
+            FileStamp stamp;
+            if (file_stamp(files[idx[j]].path, stamp)) st[j] = stamp;
+        });
+        for (size_t j=0;j<idx.size();++j) {
+            if (!st[j]) continue;
+            stamps[idx[j]] = *st[j];
+            Digest d;
+            if (ph.cache.lookup(*st[j], args.hash, d)) cached[idx[j]] = d;
+        }
+    }
+    std::vector<std::vector<size_t>> settled, unsettled;
+    for (auto& g : candidates) {
+        bool all = true;
+        for (size_t i : g) all = all && cached.count(i);
+        (all ? settled : unsettled).push_back(std::move(g));
+    }
+
+    // Unchanged files keep their sample digests too, so one the prefilter
+    // eliminated last time is not read again.
+    SampleCache samples;
+    samples.lookup = [&](size_t i, const PrefilterRound& r, Digest& d) {
+        auto st = stamps.find(i);
+        return st != stamps.end() && ph.cache.lookup_sample(st->second, args.hash, r, d);
+    };
+    samples.store = [&](size_t i, const PrefilterRound& r, const Digest& d) {
+        auto st = stamps.find(i);
+        if (st != stamps.end()) ph.cache.store_sample(st->second, args.hash, r, d);
+    };
+    std::vector<size_t> failed;
+    {
+        StageSpan span(Stage::Prefilter);
+        candidates = prefilter_groups(files, std::move(unsettled), ph.rounds, args.hash, args.threads,
+                                      ph.roundStats, failed, args.cache.empty() ? nullptr : &samples);
+    }
+    for (size_t i : failed) out.error(ReportError::Hash, files[i].path);
+    candidates.insert(candidates.end(), settled.begin(), settled.end());
+    // same order with or without cache hits
+    std::sort(candidates.begin(), candidates.end(), [&](const auto& x, const auto& y) { return groupLess(x[0], y[0]); });
+
+    // Small groups (pairs, by default) are settled by one lockstep read of
+    // their members instead of a full digest of each. With --cache the digests
+    // are worth keeping, so every group is hashed.
+    std::vector<char> compareGroup(candidates.size(), 0);
+    std::vector<size_t> compareJobs;
+    if (args.cache.empty() && args.compare_max >= 2) {
+        for (size_t g=0;g<candidates.size();++g) {
+            if (candidates[g].size() > args.compare_max) continue;
+            compareGroup[g] = 1;
+            compareJobs.push_back(g);
+        }
+    }
+
+    // Full digests: reads are queued on io_uring (or the worker pool) and
+    // results land in per-job slots merged in job order, so output does not
+    // depend on the thread count or completion order.
+    std::vector<size_t> jobs;
+    std::vector<size_t> groupJobsEnd(candidates.size());
+    for (size_t g=0;g<candidates.size();++g) {
+        if (!compareGroup[g]) jobs.insert(jobs.end(), candidates[g].begin(), candidates[g].end());
+        groupJobsEnd[g] = jobs.size();
+    }
+    std::vector<std::optional<Digest>> digests(jobs.size());
+    std::vector<size_t> pending;
+    std::vector<fs::path> pendingPaths;
+    std::vector<std::uintmax_t> pendingSizes;
+    for (size_t j=0;j<jobs.size();++j) {
+        auto it = cached.find(jobs[j]);
+        if (it != cached.end()) digests[j] = it->second;
+        else {
+            pending.push_back(j);
+            pendingPaths.push_back(files[jobs[j]].path);
+            pendingSizes.push_back(files[jobs[j]].size);
+        }
+    }
+    {
+        // small files are digested in multi-buffer batches
+        StageSpan span(Stage::Hash);
+        auto out = hash_files(pendingPaths, pendingSizes, args.hash, args.threads, args.queue_depth);
+        for (size_t k=0;k<pending.size();++k) digests[pending[k]] = out[k];
+    }
+    if (!args.cache.empty()) {
+        for (size_t j=0;j<jobs.size();++j) {
+            auto st = stamps.find(jobs[j]);
+            if (digests[j] && st != stamps.end() && !cached.count(jobs[j])) ph.cache.store(st->second, args.hash, *digests[j]);
+        }
+    }
+
+    // Lockstep comparison of the small groups, one group per worker.
+    std::vector<std::vector<std::vector<size_t>>> compared(candidates.size());
+    std::vector<std::vector<size_t>> compareFailed(candidates.size());
+    {
+        StageSpan span(Stage::Compare);
+        parallel_for(compareJobs.size(), args.threads, [&](size_t k) {
+            auto& g = candidates[compareJobs[k]];
+            StageItem item(Stage::Compare, g.size(), g.size() * files[g[0]].size);
+            std::vector<fs::path> paths;
+            for (size_t i : g) paths.push_back(files[i].path);
+            std::vector<size_t> bad;
+            auto classes = lockstep_compare(paths, bad);
+            for (auto& c : classes) for (auto& i : c) i = g[i];
+            for (auto& i : bad) i = g[i];
+            compared[compareJobs[k]] = std::move(classes);
+            compareFailed[compareJobs[k]] = std::move(bad);
+        });
+    }
+
+    // Duplicate sets in group order. Buckets hold indices into `files`, keyed by
+    // a fixed-size binary key; a bucket never spans two candidate groups.
+    struct DupSet {
+        std::uint32_t ext;
+        std::uint64_t size;
+        const Digest* digest;                   // null: members were byte-compared
+        std::vector<std::uint32_t> members;
+    };
+    std::vector<DupSet> sets;
+    std::unordered_map<BucketKey, std::vector<std::uint32_t>, BucketKeyHash> buckets;
+    for (size_t g=0, j=0;g<candidates.size();++g) {
+        if (compareGroup[g]) {
+            for (size_t i : compareFailed[g]) out.error(ReportError::Read, files[i].path);
+            for (auto& c : compared[g]) {
+                ph.comparedFiles += c.size();
+                if (c.size() < 2) continue;
+                sets.push_back({extOf[c[0]], files[c[0]].size, nullptr, {c.begin(), c.end()}});
+            }
+            continue;
+        }
+        std::vector<const Bucket*> bucketOrder;                          // first-seen order
+        for (; j<groupJobsEnd[g]; ++j) {
+            auto& fi = files[jobs[j]];
+            if (!digests[j]) {
+                out.error(ReportError::Hash, fi.path);
+                continue;
+            }
+            BucketKey key{fi.size, extOf[jobs[j]], (std::uint32_t)args.hash, *digests[j]};
+            auto& slot = *buckets.try_emplace(key).first;
+            if (slot.second.empty()) bucketOrder.push_back(&slot);
+            slot.second.push_back((std::uint32_t)jobs[j]);
+            ++ph.hashed;
+        }
+        for (auto* bucket : bucketOrder) {
+            if (bucket->second.size() < 2) continue;
+            sets.push_back({bucket->first.ext, bucket->first.size, &bucket->first.digest, bucket->second});
+        }
+    }
+
+    // Confirmation before destructive actions: members of a digest-matched set
+    // are read in lockstep and the set splits wherever their bytes diverge.
+    // Non-cryptographic digests are always confirmed. A reflink needs no check
+    // of its own: FIDEDUPERANGE compares under lock.
+    const bool verify = args.commit && args.action != DedupAction::Reflink &&
+                        (args.verify || !hash_algo_is_cryptographic(args.hash));
+    std::vector<std::vector<std::vector<std::uint32_t>>> confirmed(sets.size());
+    std::vector<std::vector<std::uint32_t>> unreadable(sets.size());
+    {
+        std::optional<StageSpan> span;
+        if (verify) span.emplace(Stage::Verify);
+        parallel_for(sets.size(), args.threads, [&](size_t k) {
+            auto& set = sets[k];
+            if (!verify || !set.digest) {
+                confirmed[k].push_back(set.members);
+                return;
+            }
+            StageItem item(Stage::Verify, set.members.size(), set.members.size() * set.size);
+            std::vector<fs::path> paths;
+            for (auto i : set.members) paths.push_back(files[i].path);
+            std::vector<size_t> bad;
+            for (auto& c : lockstep_compare(paths, bad)) {
+                confirmed[k].emplace_back();
+                for (size_t i : c) confirmed[k].back().push_back(set.members[i]);
+            }
+            for (size_t i : bad) unreadable[k].push_back(set.members[i]);
+        });
+    }
+
+    // Paths that already share an inode: nothing to reclaim, nothing read.
+    {
+        std::vector<std::uint32_t> inodes;
+        for (auto& [first, rest] : aliases) inodes.push_back(first);
+        std::sort(inodes.begin(), inodes.end());
+        for (auto i : inodes) {
+            std::vector<fs::path> paths{files[i].path};
+            for (auto a : aliases[i]) paths.push_back(files[a].path);
+            out.hard_links(ph.extNames[extOf[i]], files[i].size, paths);
+        }
+    }
+
+    const char* algoName = hash_algo_name(args.hash);
+    for (size_t k=0;k<sets.size();++k) {
+        auto& set = sets[k];
+        for (auto i : unreadable[k]) out.error(ReportError::Read, files[i].path);
+        // Members that match no other member: an equal digest, different bytes.
+        std::vector<std::uint32_t> loners;
+        for (auto& c : confirmed[k]) if (c.size() == 1) loners.push_back(c[0]);
+        bool first = true;
+        for (auto& vec : confirmed[k]) {
+            if (vec.size() < 2) continue;
+            ++ph.dupSets;
+            //stable keep-first
+            auto& keep = files[vec[0]].path;
+            DuplicateSetRecord rec;
+            rec.ext = ph.extNames[set.ext];
+            rec.size = set.size;
+            if (set.digest) { rec.algo = digest_name(args.hash, set.size); rec.digest = digest_hex(*set.digest, args.hash); }
+            rec.action = args.action;
+            // Reflinks for the whole set go to the kernel together.
+            std::vector<ReflinkStatus> shared;
+            if (args.commit && args.action == DedupAction::Reflink) {
+                std::vector<fs::path> dups;
+                for (size_t i=1;i<vec.size();++i) dups.push_back(files[vec[i]].path);
+                StageTimer timer(Stage::Action, set.size * dups.size());
+                shared = reflink_dedupe(keep, dups);
+            }
+            auto linked = [&](std::uint32_t i) -> const std::vector<std::uint32_t>& {
+                static const std::vector<std::uint32_t> none;
+                auto it = aliases.find(i);
+                return it == aliases.end() ? none : it->second;
+            };
+            for (size_t i=0;i<vec.size();++i) {
+                auto& p = files[vec[i]].path;
+                if (i==0) {
+                    rec.members.push_back({SetMember::Keep, p});
+                    for (auto a : linked(vec[i])) rec.members.push_back({SetMember::Keep, files[a].path, true});
+                    continue;
+                }
+                if (args.commit && args.action == DedupAction::Reflink && shared[i-1] == ReflinkStatus::Differs) {
+                    rec.members.push_back({SetMember::Skipped, p, false, "content differs from KEEP"});
+                    continue;
+                }
+                // Every path of the inode: one left behind would keep its blocks alive.
+                // A reflink shares the inode's extents, so its other paths are done too.
+                std::vector<std::uint32_t> targets{vec[i]};
+                for (auto a : linked(vec[i])) targets.push_back(a);
+                for (size_t t=0;t<targets.size();++t) {
+                    auto& q = files[targets[t]].path;
+                    bool ok = true;
+                    std::string why;
+                    if (args.commit) {
+                        std::error_code ec;
+                        switch (args.action) {
+                            case DedupAction::Delete: {
+                                StageTimer timer(Stage::Action, set.size);
+                                ok = delete_file(q);
+                                break;
+                            }
+                            case DedupAction::Hardlink: {
+                                StageTimer timer(Stage::Action, set.size);
+                                ok = hardlink_replace(keep, q, ec);
+                                if (!ok) why = ec.message();
+                                break;
+                            }
+                            case DedupAction::Reflink:
+                                ok = shared[i-1] == ReflinkStatus::Shared;
+                                if (!ok) why = "FIDEDUPERANGE failed";
+                                break;
+                        }
+                    }
+                    if (!ok) {
+                        rec.members.push_back({SetMember::Failed, q, t != 0, why});
+                        ++ph.failedActions;
+                        continue;
+                    }
+                    rec.members.push_back({SetMember::Acted, q, t != 0});
+                    ++ph.removable;
+                }
+            }
+            if (first) {
+                for (auto i : loners) rec.members.push_back({SetMember::Skipped, files[i].path, false, "content differs from KEEP"});
+                loners.clear();
+                first = false;
+            }
+            out.duplicate_set(rec);
+        }
+        for (auto i : loners) out.error(ReportError::DigestCollision, files[i].path, algoName);
+    }
+}
+
+/// Phase-2 over `files`, once per inode.
+static void within_file_pass(const ScanOptions& args, const std::vector<FileInfo>& files, Reporter& out) {
+    std::set<std::pair<std::uint64_t, std::uint64_t>> seen;    // inodes done
+    for (auto& fi : files) {
+        if (has_inode(fi) && !seen.emplace(fi.dev, fi.ino).second) continue;
+        if (!args.only_ext.empty() && args.only_ext.count(fi.path.extension().string())==0) continue;
+
+        std::string report;
+        bool changed = false;
+        try {
+            auto ext = fi.path.extension().string();
+            if (ext == ".docx") {
+                changed = docx_dedupe_paragraphs_inplace(fi.path, args.commit, report);
+            } else if (ext == ".xlsx") {
+                changed = xlsx_dedupe_rows_inplace(fi.path, args.commit, report);
+            } else if (ext == ".txt") {
+                // optional: simple line de-dup (keep first occurrence)
+                // read, fingerprint lines, rewrite if needed
+                // (left as-is to keep focus on docx/xlsx)
+            }
+        } catch (const std::exception& e) {
+            report += std::string("  [ERR] ") + e.what() + "\n";
+        }
+        if (!report.empty()) out.within_file(fi.path, report, changed, args.commit);
+    }
+}
+
+struct DedupSession::Impl {
+    ScanOptions opt;
+    Reporter& out;
+    std::vector<fs::path> roots, canonRoots;        // as given / for the overlap check
+    std::vector<FileInfo> files;
+    std::unique_ptr<ExternalFileSort> sorter;
+    SummaryRecord sum;
+};
+
+DedupSession::DedupSession(ScanOptions opt, Reporter& out) : impl_(new Impl{std::move(opt), out}) {}
+
+DedupSession::~DedupSession() = default;
+
+// `a` is `b` or below it.
+static bool path_within(const fs::path& a, const fs::path& b) {
+    auto ai = a.begin();
+    for (auto bi = b.begin(); bi != b.end(); ++bi, ++ai) {
+        if (ai == a.end() || *ai != *bi) return false;
+    }
+    return true;
+}
+
+bool DedupSession::add_root(const fs::path& dir) {
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec)) return false;
+    auto canon = fs::weakly_canonical(dir, ec);
+    if (ec) return false;
+    for (auto& r : impl_->canonRoots) {
+        if (path_within(canon, r) || path_within(r, canon)) return false;
+    }
+    impl_->roots.push_back(dir);
+    impl_->canonRoots.push_back(canon);
+    return true;
+}
+
+bool DedupSession::scan() {
+    Impl& s = *impl_;
+    const ScanOptions& args = s.opt;
+    Reporter& out = s.out;
+
+    if (args.mmap_threshold) set_mmap_threshold(*args.mmap_threshold);
+    set_mmap_hugepages(args.hugepages);
+    if (args.tree_threshold) set_tree_threshold(*args.tree_threshold);
+    set_tree_threads(args.threads);
+
+    std::vector<std::string> ext_filter(args.only_ext.begin(), args.only_ext.end());
+
+    // Progressive prefilter: split each size group on small samples so that
+    // only files that survive every round get a full-content digest.
+    Phase1 ph{args, out};
+    ph.rounds = make_prefilter_rounds(args.prefilter_rounds, args.sample_size);
+    for (auto& r : ph.rounds) ph.roundStats.push_back({r});
+
+    // Persistent cache: digests of files whose stat() identity is unchanged are
+    // reused. Groups whose members all hit skip the prefilter and hashing entirely.
+    if (!args.cache.empty() && !ph.cache.load(args.cache)) {
+        out.error(ReportError::CacheRead, args.cache);
+    }
+
+    s.files.clear();
+    s.sorter.reset();
+    if (!args.max_memory) {
+        {
+            StageSpan span(Stage::Walk);
+            for (auto& root : s.roots) {
+                auto listed = list_target_files(root, args.recurse, ext_filter, args.threads);
+                if (s.files.empty()) s.files = std::move(listed);
+                else s.files.insert(s.files.end(), std::make_move_iterator(listed.begin()),
+                                    std::make_move_iterator(listed.end()));
+            }
+        }
+        if (stats_enabled()) {
+            std::uintmax_t bytes = 0;
+            for (auto& f : s.files) bytes += f.size;
+            stats_count(Stage::Walk, s.files.size(), bytes);
+        }
+        process_batch(ph, s.files);
+    } else {
+        // Bounded memory: records spill to sorted runs (half the budget) and come
+        // back one size group at a time; groups are processed in batches of up to
+        // a quarter of the budget, so only those records are resident. The
+        // sort needs 1 MiB, so smaller budgets are raised to 2 MiB.
+        const std::uintmax_t budget = std::max<std::uintmax_t>(args.max_memory, std::uintmax_t(2) << 20);
+        std::error_code ec;
+        auto tmp = args.temp_dir.empty() ? fs::temp_directory_path(ec) : args.temp_dir;
+        s.sorter.reset(new ExternalFileSort(tmp, (size_t)(budget / 2)));
+        bool ok = true;
+        std::uintmax_t walked = 0, walkedBytes = 0;
+        {
+            // includes spilling sort runs, which happens inside the sink
+            StageSpan span(Stage::Walk);
+            for (auto& root : s.roots) {
+                walk_target_files(root, args.recurse, ext_filter, args.threads, [&](FileInfo&& f) {
+                    ++walked;
+                    walkedBytes += f.size;
+                    ok = s.sorter->add(std::move(f)) && ok;
+                });
+            }
+        }
+        stats_count(Stage::Walk, walked, walkedBytes);
+        if (!ok || !s.sorter->rewind()) {
+            out.error(ReportError::SortRuns, tmp);
+            s.sorter.reset();
+            return false;
+        }
+        std::vector<FileInfo> batch;
+        std::vector<FileInfo> group;
+        size_t batchBytes = 0;
+        while (s.sorter->next_group(group)) {
+            for (auto& f : group) {
+                batchBytes += sizeof(FileInfo) + f.path.native().size() * sizeof(fs::path::value_type);
+                batch.push_back(std::move(f));
+            }
+            if (batchBytes < budget / 4) continue;
+            process_batch(ph, batch);
+            batch.clear();
+            batchBytes = 0;
+        }
+        if (!batch.empty()) process_batch(ph, batch);
+    }
+    if (!args.cache.empty() && !ph.cache.save(args.cache)) {
+        out.error(ReportError::CacheWrite, args.cache);
+    }
+
+    SummaryRecord& sum = s.sum;
+    sum = SummaryRecord();
+    sum.scanned = ph.scanned;
+    sum.skipped_files = ph.skippedFiles;
+    sum.skipped_bytes = ph.skippedBytes;
+    sum.linked_paths = ph.linkedPaths;
+    sum.hashed = ph.hashed;
+    sum.compared = ph.comparedFiles;
+    for (auto& st : ph.roundStats) {
+        sum.rounds.push_back({prefilter_round_name(st.round.kind), st.round.bytes, st.sampled, st.cached,
+                              st.eliminated});
+    }
+    if (!args.cache.empty()) sum.cache = std::make_pair(ph.cache.hits(), ph.cache.misses());
+    if (s.sorter) sum.sort_runs = s.sorter->runs();
+    sum.dup_sets = ph.dupSets;
+    sum.removable = ph.removable;
+    sum.failed_actions = ph.failedActions;
+    sum.action = args.action;
+    out.summary(sum);
+    return true;
+}
+
+void DedupSession::dedupe_within() {
+    Impl& s = *impl_;
+    if (!s.sorter) {
+        within_file_pass(s.opt, s.files, s.out);
+    } else if (s.sorter->rewind()) {
+        std::vector<FileInfo> group;
+        while (s.sorter->next_group(group)) within_file_pass(s.opt, group, s.out);
+    }
+}
+
+void DedupSession::analyze_chunks() {
+    Impl& s = *impl_;
+    const ScanOptions& args = s.opt;
+    // Every file once per inode, in the same order on each call; false if the
+    // listing could not be read back.
+    auto each_file = [&](const std::function<void(std::uint32_t, const FileInfo&)>& fn) {
+        std::uint32_t id = 0;
+        // Paths to one inode have one size, so they land in the same group.
+        auto visit = [&](const std::vector<FileInfo>& files) {
+            std::set<std::pair<std::uint64_t, std::uint64_t>> seen;
+            for (auto& fi : files) {
+                if (has_inode(fi) && !seen.emplace(fi.dev, fi.ino).second) continue;
+                if (!args.only_ext.empty() && args.only_ext.count(fi.path.extension().string())==0) continue;
+                fn(id++, fi);
+            }
+        };
+        if (!s.sorter) {
+            visit(s.files);
+            return true;
+        }
+        if (!s.sorter->rewind()) return false;
+        std::vector<FileInfo> group;
+        while (s.sorter->next_group(group)) visit(group);
+        return true;
+    };
+
+    StageSpan span(Stage::Chunk);
+    ChunkAnalysis chunks(args.hash, args.chunk_size, args.chunk_memory);
+    bool listed = each_file([&](std::uint32_t id, const FileInfo& fi) {
+        std::error_code ec;
+        if (args.commit && !fs::exists(fi.path, ec)) return;    // removed by Phase-1
+        if (!chunks.add_file(id, fi.path)) s.out.error(ReportError::Read, fi.path);
+    });
+    if (!listed) return;
+
+    // Only the listed pairs need their paths back.
+    auto wanted = chunks.reported_files();
+    std::unordered_map<std::uint32_t, FileInfo> files;
+    each_file([&](std::uint32_t id, const FileInfo& fi) {
+        if (std::binary_search(wanted.begin(), wanted.end(), id)) files.emplace(id, fi);
+    });
+    chunks.report(s.out, files);
+}
+
+bool DedupSession::ingest(const fs::path& store) {
+    Impl& s = *impl_;
+    const ScanOptions& args = s.opt;
+
+    if (args.mmap_threshold) set_mmap_threshold(*args.mmap_threshold);
+    set_mmap_hugepages(args.hugepages);
+
+    std::unique_ptr<ChunkStore> cs;
+    try {
+        cs.reset(new ChunkStore(store, ChunkStoreOptions{args.hash, args.chunk_size, args.compress_level, args.threads}));
+    } catch (const std::exception& e) {
+        s.out.error(ReportError::StoreOpen, store, e.what());
+        return false;
+    }
+
+    std::vector<std::string> ext_filter(args.only_ext.begin(), args.only_ext.end());
+    std::vector<StoreFile> files;
+    {
+        StageSpan span(Stage::Walk);
+        std::error_code ec;
+        auto canonStore = fs::weakly_canonical(store, ec);
+        std::uintmax_t bytes = 0;
+        for (size_t r=0;r<s.roots.size();++r) {
+            // a store inside the tree must not ingest itself
+            fs::path inside;
+            if (!ec && path_within(canonStore, s.canonRoots[r])) inside = canonStore.lexically_relative(s.canonRoots[r]);
+            // With several roots each gets its own directory of recipes, named
+            // after the root; "root<N>" if that name is empty or taken.
+            fs::path prefix;
+            if (s.roots.size() > 1) {
+                prefix = s.canonRoots[r].filename();
+                for (size_t q=0;q<r && !prefix.empty();++q) {
+                    if (s.canonRoots[q].filename() == prefix) prefix.clear();
+                }
+                if (prefix.empty()) prefix = "root" + std::to_string(r + 1);
+            }
+            for (auto& f : list_target_files(s.roots[r], args.recurse, ext_filter, args.threads)) {
+                auto name = f.path.lexically_relative(s.roots[r]);
+                if (!inside.empty() && path_within(name, inside)) continue;
+                bytes += f.size;
+                files.push_back({f.path, prefix / name});
+            }
+        }
+        stats_count(Stage::Walk, files.size(), bytes);
+    }
+    StageSpan span(Stage::Store);
+    return cs->ingest(files, s.out);
+}
+
+const SummaryRecord& DedupSession::summary() const { return impl_->sum; }
+
+const std::vector<FileInfo>& DedupSession::files() const { return impl_->files; }
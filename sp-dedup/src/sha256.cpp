@@ -0,0 +1,499 @@
+#include "sha256.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SP_SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+    const std::uint32_t K[64] = {
+        0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+        0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+        0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+        0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+        0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+        0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+        0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+        0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+    };
+
+    using CompressFn = void (*)(std::uint32_t state[8], const unsigned char* data, size_t nblocks);
+    // Lane-parallel block function: state[word][lane], in[schedule word][lane].
+    using CompressManyFn = void (*)(std::uint32_t state[8][16], std::uint32_t in[16][16]);
+
+    const std::uint32_t kIv[8] = {
+        0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+    };
+
+    inline std::uint32_t rotr(std::uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+    inline std::uint32_t load_be32(const unsigned char* p) {
+        return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+    }
+
+    // 64 rounds over an expanded schedule; shared by the scalar and AVX2 paths.
+    inline __attribute__((always_inline)) void rounds(std::uint32_t state[8], const std::uint32_t W[64]) {
+        std::uint32_t a=state[0], b=state[1], c=state[2], d=state[3], e=state[4], f=state[5], g=state[6], h=state[7];
+        for (int t = 0; t < 64; ++t) {
+            std::uint32_t S1 = rotr(e,6) ^ rotr(e,11) ^ rotr(e,25);
+            std::uint32_t ch = (e & f) ^ (~e & g);
+            std::uint32_t t1 = h + S1 + ch + K[t] + W[t];
+            std::uint32_t S0 = rotr(a,2) ^ rotr(a,13) ^ rotr(a,22);
+            std::uint32_t mj = (a & b) ^ (a & c) ^ (b & c);
+            std::uint32_t t2 = S0 + mj;
+            h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0]+=a; state[1]+=b; state[2]+=c; state[3]+=d; state[4]+=e; state[5]+=f; state[6]+=g; state[7]+=h;
+    }
+
+    void compress_scalar(std::uint32_t state[8], const unsigned char* data, size_t nblocks) {
+        std::uint32_t W[64];
+        for (; nblocks; --nblocks, data += 64) {
+            for (int t = 0; t < 16; ++t) W[t] = load_be32(data + 4*t);
+            for (int t = 16; t < 64; ++t) {
+                std::uint32_t s0 = rotr(W[t-15],7) ^ rotr(W[t-15],18) ^ (W[t-15] >> 3);
+                std::uint32_t s1 = rotr(W[t-2],17) ^ rotr(W[t-2],19) ^ (W[t-2] >> 10);
+                W[t] = W[t-16] + s0 + W[t-7] + s1;
+            }
+            rounds(state, W);
+        }
+    }
+
+#ifdef SP_SHA256_X86
+    // AVX2 path: the message schedules of two consecutive blocks are expanded
+    // together (one block per 128-bit lane, four words per step); the rounds
+    // are compiled with BMI2 so rotates become RORX.
+    __attribute__((target("avx2,bmi2"))) inline __m256i vrotr(__m256i x, int n) {
+        return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+    }
+    __attribute__((target("avx2,bmi2"))) inline __m256i vsig0(__m256i x) {
+        return _mm256_xor_si256(_mm256_xor_si256(vrotr(x, 7), vrotr(x, 18)), _mm256_srli_epi32(x, 3));
+    }
+    __attribute__((target("avx2,bmi2"))) inline __m256i vsig1(__m256i x) {
+        return _mm256_xor_si256(_mm256_xor_si256(vrotr(x, 17), vrotr(x, 19)), _mm256_srli_epi32(x, 10));
+    }
+
+    __attribute__((target("avx2,bmi2")))
+    void schedule_x2(const unsigned char* b0, const unsigned char* b1, std::uint32_t W0[64], std::uint32_t W1[64]) {
+        const __m256i bswap = _mm256_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12,
+                                               3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+        __m256i X[4];
+        for (int i = 0; i < 4; ++i) {
+            __m256i v = _mm256_set_m128i(_mm_loadu_si128((const __m128i*)(b1 + 16*i)),
+                                         _mm_loadu_si128((const __m128i*)(b0 + 16*i)));
+            X[i] = _mm256_shuffle_epi8(v, bswap);
+            _mm_storeu_si128((__m128i*)(W0 + 4*i), _mm256_castsi256_si128(X[i]));
+            _mm_storeu_si128((__m128i*)(W1 + 4*i), _mm256_extracti128_si256(X[i], 1));
+        }
+        const __m256i zero = _mm256_setzero_si256();
+        for (int t = 16; t < 64; t += 4) {
+            __m256i w15 = _mm256_alignr_epi8(X[1], X[0], 4);     // W[t-15..t-12]
+            __m256i w7  = _mm256_alignr_epi8(X[3], X[2], 4);     // W[t-7..t-4]
+            __m256i w = _mm256_add_epi32(_mm256_add_epi32(X[0], vsig0(w15)), w7);
+            // words t, t+1 need sigma1 of W[t-2], W[t-1]
+            __m256i lo = vsig1(_mm256_shuffle_epi32(X[3], _MM_SHUFFLE(3,3,3,2)));
+            w = _mm256_add_epi32(w, _mm256_blend_epi32(zero, lo, 0x33));
+            // words t+2, t+3 need sigma1 of the words just produced
+            __m256i hi = vsig1(_mm256_shuffle_epi32(w, _MM_SHUFFLE(1,0,1,0)));
+            w = _mm256_add_epi32(w, _mm256_blend_epi32(zero, hi, 0xCC));
+            X[0] = X[1]; X[1] = X[2]; X[2] = X[3]; X[3] = w;
+            _mm_storeu_si128((__m128i*)(W0 + t), _mm256_castsi256_si128(w));
+            _mm_storeu_si128((__m128i*)(W1 + t), _mm256_extracti128_si256(w, 1));
+        }
+    }
+
+    __attribute__((target("avx2,bmi2")))
+    void compress_avx2(std::uint32_t state[8], const unsigned char* data, size_t nblocks) {
+        alignas(32) std::uint32_t W0[64], W1[64];
+        for (; nblocks >= 2; nblocks -= 2, data += 128) {
+            schedule_x2(data, data + 64, W0, W1);
+            rounds(state, W0);
+            rounds(state, W1);
+        }
+        if (nblocks) {
+            schedule_x2(data, data, W0, W1);
+            rounds(state, W0);
+        }
+    }
+
+    // SHA-NI path (Intel SHA extensions); state is kept as ABEF/CDGH.
+    __attribute__((target("sha,sse4.1")))
+    void compress_shani(std::uint32_t state[8], const unsigned char* data, size_t nblocks) {
+        const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+        __m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+        __m128i st1 = _mm_loadu_si128((const __m128i*)&state[4]);
+        tmp = _mm_shuffle_epi32(tmp, 0xB1);              // CDAB
+        st1 = _mm_shuffle_epi32(st1, 0x1B);              // EFGH
+        __m128i st0 = _mm_alignr_epi8(tmp, st1, 8);      // ABEF
+        st1 = _mm_blend_epi16(st1, tmp, 0xF0);           // CDGH
+
+        for (; nblocks; --nblocks, data += 64) {
+            const __m128i abef = st0, cdgh = st1;
+            __m128i m[4];
+            for (int i = 0; i < 16; ++i) {
+                __m128i& cur = m[i & 3];
+                if (i < 4) {
+                    cur = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16*i)), MASK);
+                } else {
+                    // m[i&3] still holds W[4i-16..4i-13]
+                    __m128i x = _mm_sha256msg1_epu32(cur, m[(i-3) & 3]);
+                    x = _mm_add_epi32(x, _mm_alignr_epi8(m[(i-1) & 3], m[(i-2) & 3], 4));
+                    cur = _mm_sha256msg2_epu32(x, m[(i-1) & 3]);
+                }
+                __m128i msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i*)&K[4*i]));
+                st1 = _mm_sha256rnds2_epu32(st1, st0, msg);
+                msg = _mm_shuffle_epi32(msg, 0x0E);
+                st0 = _mm_sha256rnds2_epu32(st0, st1, msg);
+            }
+            st0 = _mm_add_epi32(st0, abef);
+            st1 = _mm_add_epi32(st1, cdgh);
+        }
+
+        tmp = _mm_shuffle_epi32(st0, 0x1B);              // FEBA
+        st1 = _mm_shuffle_epi32(st1, 0xB1);              // DCHG
+        st0 = _mm_blend_epi16(tmp, st1, 0xF0);           // DCBA
+        st1 = _mm_alignr_epi8(st1, tmp, 8);              // ABEF
+        _mm_storeu_si128((__m128i*)&state[0], st0);
+        _mm_storeu_si128((__m128i*)&state[4], st1);
+    }
+
+    // ---- multi-buffer: one message per 32-bit lane ----
+    // W holds 16 schedule words per lane, word-major (W[t][lane]), already
+    // byte-swapped; the schedule is extended in place as the rounds go.
+
+    __attribute__((target("avx2"))) inline __m256i xrotr8(__m256i x, int n) {
+        return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+    }
+
+    __attribute__((target("avx2")))
+    void compress_x8(std::uint32_t state[8][16], std::uint32_t in[16][16]) {
+        __m256i W[16];
+        for (int t = 0; t < 16; ++t) W[t] = _mm256_loadu_si256((const __m256i*)in[t]);
+        __m256i v[8];
+        for (int i = 0; i < 8; ++i) v[i] = _mm256_loadu_si256((const __m256i*)state[i]);
+        __m256i a=v[0], b=v[1], c=v[2], d=v[3], e=v[4], f=v[5], g=v[6], h=v[7];
+        for (int t = 0; t < 64; ++t) {
+            __m256i& w = W[t & 15];
+            if (t >= 16) {
+                __m256i w15 = W[(t - 15) & 15], w2 = W[(t - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(xrotr8(w15, 7), xrotr8(w15, 18)), _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(xrotr8(w2, 17), xrotr8(w2, 19)), _mm256_srli_epi32(w2, 10));
+                w = _mm256_add_epi32(_mm256_add_epi32(w, s0), _mm256_add_epi32(W[(t - 7) & 15], s1));
+            }
+            __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(xrotr8(e, 6), xrotr8(e, 11)), xrotr8(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                                          _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32((int)K[t])), w));
+            __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(xrotr8(a, 2), xrotr8(a, 13)), xrotr8(a, 22));
+            __m256i mj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+            h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+            d = c; c = b; b = a; a = _mm256_add_epi32(t1, _mm256_add_epi32(S0, mj));
+        }
+        __m256i r[8] = {a, b, c, d, e, f, g, h};
+        for (int i = 0; i < 8; ++i) _mm256_storeu_si256((__m256i*)state[i], _mm256_add_epi32(v[i], r[i]));
+    }
+
+    // AVX-512F: native rotates, and ternary logic for Ch, Maj and the three-way XORs.
+    // (GCC's own _mm512_undefined_epi32() trips -Wuninitialized in these intrinsics.)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    __attribute__((target("avx512f")))
+    void compress_x16(std::uint32_t state[8][16], std::uint32_t in[16][16]) {
+        __m512i W[16];
+        for (int t = 0; t < 16; ++t) W[t] = _mm512_loadu_si512(in[t]);
+        __m512i v[8];
+        for (int i = 0; i < 8; ++i) v[i] = _mm512_loadu_si512(state[i]);
+        __m512i a=v[0], b=v[1], c=v[2], d=v[3], e=v[4], f=v[5], g=v[6], h=v[7];
+        for (int t = 0; t < 64; ++t) {
+            __m512i& w = W[t & 15];
+            if (t >= 16) {
+                __m512i w15 = W[(t - 15) & 15], w2 = W[(t - 2) & 15];
+                __m512i s0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(w15, 7), _mm512_ror_epi32(w15, 18),
+                                                       _mm512_srli_epi32(w15, 3), 0x96);
+                __m512i s1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(w2, 17), _mm512_ror_epi32(w2, 19),
+                                                       _mm512_srli_epi32(w2, 10), 0x96);
+                w = _mm512_add_epi32(_mm512_add_epi32(w, s0), _mm512_add_epi32(W[(t - 7) & 15], s1));
+            }
+            __m512i S1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11),
+                                                   _mm512_ror_epi32(e, 25), 0x96);
+            __m512i ch = _mm512_ternarylogic_epi32(e, f, g, 0xCA);
+            __m512i t1 = _mm512_add_epi32(_mm512_add_epi32(h, S1),
+                                          _mm512_add_epi32(_mm512_add_epi32(ch, _mm512_set1_epi32((int)K[t])), w));
+            __m512i S0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13),
+                                                   _mm512_ror_epi32(a, 22), 0x96);
+            __m512i mj = _mm512_ternarylogic_epi32(a, b, c, 0xE8);
+            h = g; g = f; f = e; e = _mm512_add_epi32(d, t1);
+            d = c; c = b; b = a; a = _mm512_add_epi32(t1, _mm512_add_epi32(S0, mj));
+        }
+        __m512i r[8] = {a, b, c, d, e, f, g, h};
+        for (int i = 0; i < 8; ++i) _mm512_storeu_si512(state[i], _mm512_add_epi32(v[i], r[i]));
+    }
+#pragma GCC diagnostic pop
+
+    bool cpu_has_avx512() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f");
+    }
+
+    bool cpu_has_shani() {
+        __builtin_cpu_init();   // may run before libgcc's constructor
+        unsigned a, b, c, d;
+        if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+        return (b & (1u << 29)) && __builtin_cpu_supports("sse4.1");
+    }
+    bool cpu_has_avx2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+    }
+#endif
+
+    CompressFn backend_fn(Sha256Backend b) {
+        switch (b) {
+#ifdef SP_SHA256_X86
+            case Sha256Backend::ShaNi: return compress_shani;
+            case Sha256Backend::Avx2:  return compress_avx2;
+#endif
+            default: return compress_scalar;
+        }
+    }
+
+    Sha256Backend detect() {
+        if (sha256_backend_supported(Sha256Backend::ShaNi)) return Sha256Backend::ShaNi;
+        if (sha256_backend_supported(Sha256Backend::Avx2)) return Sha256Backend::Avx2;
+        return Sha256Backend::Scalar;
+    }
+
+    Sha256Backend g_backend = detect();
+    CompressFn g_compress = backend_fn(g_backend);
+
+    CompressManyFn many_fn(Sha256ManyBackend b) {
+        switch (b) {
+#ifdef SP_SHA256_X86
+            case Sha256ManyBackend::Avx2x8:    return compress_x8;
+            case Sha256ManyBackend::Avx512x16: return compress_x16;
+#endif
+            default: return nullptr;
+        }
+    }
+
+    // Eight or sixteen 32-bit lanes beat one SHA-NI stream; eight lanes of
+    // AVX2 do not, so they are only used without SHA-NI.
+    Sha256ManyBackend detect_many() {
+        if (sha256_many_backend_supported(Sha256ManyBackend::Avx512x16)) return Sha256ManyBackend::Avx512x16;
+        if (g_backend != Sha256Backend::ShaNi && sha256_many_backend_supported(Sha256ManyBackend::Avx2x8))
+            return Sha256ManyBackend::Avx2x8;
+        return Sha256ManyBackend::Serial;
+    }
+
+    Sha256ManyBackend g_many = detect_many();
+
+    void store_digest(const std::uint32_t state[8], unsigned char out[32]) {
+        for (int i = 0; i < 8; ++i) {
+            out[4*i]   = (unsigned char)(state[i] >> 24);
+            out[4*i+1] = (unsigned char)(state[i] >> 16);
+            out[4*i+2] = (unsigned char)(state[i] >> 8);
+            out[4*i+3] = (unsigned char)(state[i]);
+        }
+    }
+
+    // One message on its way through a lane: whole blocks straight from the
+    // caller's buffer, then one or two blocks of tail, padding and length.
+    struct Lane {
+        const unsigned char* data = nullptr;
+        size_t full = 0;                // whole 64-byte blocks in the message
+        size_t block = 0, nblocks = 0;  // next block, total with padding
+        size_t msg = 0;                 // index into the batch
+        unsigned char tail[128];
+    };
+
+    void lane_start(Lane& l, const unsigned char* data, size_t len, size_t msg) {
+        l.data = data;
+        l.full = len / 64;
+        l.block = 0;
+        l.msg = msg;
+        size_t rem = len % 64;
+        size_t tailBlocks = rem + 9 <= 64 ? 1 : 2;
+        l.nblocks = l.full + tailBlocks;
+        std::memset(l.tail, 0, sizeof(l.tail));
+        if (rem) std::memcpy(l.tail, data + 64 * l.full, rem);
+        l.tail[rem] = 0x80;
+        std::uint64_t bits = std::uint64_t(len) * 8;
+        unsigned char* end = l.tail + 64 * tailBlocks;
+        for (int i = 0; i < 8; ++i) end[-1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    const unsigned char* lane_block(const Lane& l) {
+        return l.block < l.full ? l.data + 64 * l.block : l.tail + 64 * (l.block - l.full);
+    }
+
+    // Messages are dealt to lanes in order and a lane takes the next one as
+    // soon as its own ends, so unequal lengths keep every lane busy until the
+    // queue runs dry. The last few stragglers finish on the single-stream core.
+    void many_lanes(size_t lanes, CompressManyFn fn, const unsigned char* const* data, const size_t* len,
+                    size_t n, unsigned char (*out)[32]) {
+        alignas(64) std::uint32_t state[8][16] = {};
+        alignas(64) std::uint32_t in[16][16] = {};
+        Lane lane[16];
+        bool busy[16] = {};
+        size_t next = 0, active = 0;
+        auto load = [&](size_t i) {
+            busy[i] = next < n;
+            if (!busy[i]) return;
+            lane_start(lane[i], data[next], len[next], next);
+            ++next;
+            ++active;
+            for (int w = 0; w < 8; ++w) state[w][i] = kIv[w];
+        };
+        for (size_t i = 0; i < lanes; ++i) load(i);
+        while (active) {
+            if (next >= n && active * 2 < lanes) {
+                for (size_t i = 0; i < lanes; ++i) {
+                    if (!busy[i]) continue;
+                    Lane& l = lane[i];
+                    std::uint32_t st[8];
+                    for (int w = 0; w < 8; ++w) st[w] = state[w][i];
+                    if (l.block < l.full) g_compress(st, lane_block(l), l.full - l.block);
+                    size_t b = std::max(l.block, l.full);
+                    g_compress(st, l.tail + 64 * (b - l.full), l.nblocks - b);
+                    store_digest(st, out[l.msg]);
+                }
+                return;
+            }
+            for (size_t i = 0; i < lanes; ++i) {
+                if (!busy[i]) continue;     // an idle lane hashes stale words; its state is discarded
+                const unsigned char* p = lane_block(lane[i]);
+                for (int t = 0; t < 16; ++t) in[t][i] = load_be32(p + 4*t);
+            }
+            fn(state, in);
+            for (size_t i = 0; i < lanes; ++i) {
+                if (!busy[i] || ++lane[i].block < lane[i].nblocks) continue;
+                std::uint32_t st[8];
+                for (int w = 0; w < 8; ++w) st[w] = state[w][i];
+                store_digest(st, out[lane[i].msg]);
+                --active;
+                load(i);
+            }
+        }
+    }
+}
+
+const char* sha256_backend_name(Sha256Backend b) {
+    switch (b) {
+        case Sha256Backend::Scalar: return "scalar";
+        case Sha256Backend::Avx2:   return "avx2";
+        case Sha256Backend::ShaNi:  return "sha-ni";
+    }
+    return "?";
+}
+
+bool sha256_backend_supported(Sha256Backend b) {
+    switch (b) {
+        case Sha256Backend::Scalar: return true;
+#ifdef SP_SHA256_X86
+        case Sha256Backend::Avx2:  return cpu_has_avx2();
+        case Sha256Backend::ShaNi: return cpu_has_shani();
+#endif
+        default: return false;
+    }
+}
+
+Sha256Backend sha256_active_backend() { return g_backend; }
+
+bool sha256_set_backend(Sha256Backend b) {
+    if (!sha256_backend_supported(b)) return false;
+    g_backend = b;
+    g_compress = backend_fn(b);
+    return true;
+}
+
+void sha256_init(Sha256Ctx& c) {
+    std::memcpy(c.state, kIv, sizeof(kIv));
+    c.total = 0;
+    c.buflen = 0;
+}
+
+void sha256_update(Sha256Ctx& c, const void* data, size_t len) {
+    auto p = static_cast<const unsigned char*>(data);
+    c.total += len;
+    if (c.buflen) {
+        size_t take = 64 - c.buflen < len ? 64 - c.buflen : len;
+        std::memcpy(c.buf + c.buflen, p, take);
+        c.buflen += take; p += take; len -= take;
+        if (c.buflen < 64) return;
+        g_compress(c.state, c.buf, 1);
+        c.buflen = 0;
+    }
+    if (len >= 64) {
+        g_compress(c.state, p, len / 64);
+        p += len & ~size_t(63);
+        len &= 63;
+    }
+    if (len) { std::memcpy(c.buf, p, len); c.buflen = len; }
+}
+
+void sha256_final(Sha256Ctx& c, unsigned char out[32]) {
+    std::uint64_t bits = c.total * 8;
+    c.buf[c.buflen++] = 0x80;
+    if (c.buflen > 56) {
+        std::memset(c.buf + c.buflen, 0, 64 - c.buflen);
+        g_compress(c.state, c.buf, 1);
+        c.buflen = 0;
+    }
+    std::memset(c.buf + c.buflen, 0, 56 - c.buflen);
+    for (int i = 0; i < 8; ++i) c.buf[56 + i] = (unsigned char)(bits >> (56 - 8*i));
+    g_compress(c.state, c.buf, 1);
+    store_digest(c.state, out);
+}
+
+const char* sha256_many_backend_name(Sha256ManyBackend b) {
+    switch (b) {
+        case Sha256ManyBackend::Serial:    return "serial";
+        case Sha256ManyBackend::Avx2x8:    return "avx2x8";
+        case Sha256ManyBackend::Avx512x16: return "avx512x16";
+    }
+    return "?";
+}
+
+bool sha256_many_backend_supported(Sha256ManyBackend b) {
+    switch (b) {
+        case Sha256ManyBackend::Serial: return true;
+#ifdef SP_SHA256_X86
+        case Sha256ManyBackend::Avx2x8:    return cpu_has_avx2();
+        case Sha256ManyBackend::Avx512x16: return cpu_has_avx512();
+#endif
+        default: return false;
+    }
+}
+
+Sha256ManyBackend sha256_active_many_backend() { return g_many; }
+
+bool sha256_set_many_backend(Sha256ManyBackend b) {
+    if (!sha256_many_backend_supported(b)) return false;
+    g_many = b;
+    return true;
+}
+
+size_t sha256_many_lanes() {
+    switch (g_many) {
+        case Sha256ManyBackend::Avx2x8:    return 8;
+        case Sha256ManyBackend::Avx512x16: return 16;
+        default:                           return 1;
+    }
+}
+
+void sha256_many(const unsigned char* const* data, const size_t* len, size_t n, unsigned char (*out)[32]) {
+    size_t lanes = sha256_many_lanes();
+    if (lanes > 1 && n > 1) {
+        many_lanes(lanes, many_fn(g_many), data, len, n, out);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        Sha256Ctx c;
+        sha256_init(c);
+        sha256_update(c, data[i], len[i]);
+        sha256_final(c, out[i]);
+    }
+}
@@ -0,0 +1,178 @@
+#include "stats.h"
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+    struct Counters {
+        std::atomic<std::uint64_t> files{0}, bytes{0}, wall_ns{0}, cpu_ns{0}, items{0}, latency_ns{0};
+        std::atomic<std::uint64_t> hist[kLatencyBuckets] = {};
+    };
+
+    std::atomic<bool> g_on{false};
+    Counters g_stage[(size_t)Stage::Count];
+
+    const char* const kNames[(size_t)Stage::Count] = {
+        "walk", "prefilter", "hash", "compare", "verify", "action", "chunk", "store",
+        "zip_read", "zip_write", "xml_parse", "xml_dedupe", "xml_write",
+    };
+
+    // CPU time of the whole process, all threads.
+    std::uint64_t process_cpu_ns() {
+#ifdef _WIN32
+        FILETIME created, exited, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+        auto ticks = [](const FILETIME& f) { return (std::uint64_t(f.dwHighDateTime) << 32) | f.dwLowDateTime; };
+        return (ticks(kernel) + ticks(user)) * 100;     // 100 ns units
+#else
+        timespec ts{};
+        if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+        return std::uint64_t(ts.tv_sec) * 1000000000u + std::uint64_t(ts.tv_nsec);
+#endif
+    }
+
+    size_t bucket_of(std::uint64_t ns) {
+        size_t b = 0;
+        while (ns) { ++b; ns >>= 1; }
+        return b < kLatencyBuckets ? b : kLatencyBuckets - 1;
+    }
+
+    std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point t0) {
+        return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+    }
+}
+
+const char* stage_name(Stage s) { return kNames[(size_t)s]; }
+
+void stats_enable(bool on) { g_on.store(on, std::memory_order_relaxed); }
+
+bool stats_enabled() { return g_on.load(std::memory_order_relaxed); }
+
+void stats_count(Stage s, std::uint64_t files, std::uint64_t bytes) {
+    if (!stats_enabled()) return;
+    auto& c = g_stage[(size_t)s];
+    c.files.fetch_add(files, std::memory_order_relaxed);
+    c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void stats_item(Stage s, std::uint64_t files, std::uint64_t bytes, std::uint64_t ns) {
+    if (!stats_enabled()) return;
+    auto& c = g_stage[(size_t)s];
+    c.files.fetch_add(files, std::memory_order_relaxed);
+    c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    c.items.fetch_add(1, std::memory_order_relaxed);
+    c.latency_ns.fetch_add(ns, std::memory_order_relaxed);
+    c.hist[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+StageSpan::StageSpan(Stage s) : stage_(s), on_(stats_enabled()) {
+    if (!on_) return;
+    t0_ = std::chrono::steady_clock::now();
+    cpu0_ = process_cpu_ns();
+}
+
+StageSpan::~StageSpan() {
+    if (!on_) return;
+    auto& c = g_stage[(size_t)stage_];
+    c.wall_ns.fetch_add(elapsed_ns(t0_), std::memory_order_relaxed);
+    std::uint64_t cpu = process_cpu_ns();
+    c.cpu_ns.fetch_add(cpu > cpu0_ ? cpu - cpu0_ : 0, std::memory_order_relaxed);
+}
+
+StageItem::~StageItem() {
+    if (on_) stats_item(stage_, files_, bytes_, elapsed_ns(t0_));
+}
+
+std::vector<StageStats> stats_snapshot() {
+    std::vector<StageStats> out;
+    for (size_t i = 0; i < (size_t)Stage::Count; ++i) {
+        auto& c = g_stage[i];
+        StageStats s;
+        s.stage = (Stage)i;
+        s.files = c.files.load(std::memory_order_relaxed);
+        s.bytes = c.bytes.load(std::memory_order_relaxed);
+        s.wall_ns = c.wall_ns.load(std::memory_order_relaxed);
+        s.cpu_ns = c.cpu_ns.load(std::memory_order_relaxed);
+        s.items = c.items.load(std::memory_order_relaxed);
+        s.latency_ns = c.latency_ns.load(std::memory_order_relaxed);
+        for (size_t b = 0; b < kLatencyBuckets; ++b) s.hist[b] = c.hist[b].load(std::memory_order_relaxed);
+        if (s.files || s.items) out.push_back(s);
+    }
+    return out;
+}
+
+std::uint64_t stats_quantile_ns(const StageStats& s, double q) {
+    if (!s.items) return 0;
+    std::uint64_t want = (std::uint64_t)(q * (double)s.items);
+    if (want >= s.items) want = s.items - 1;
+    std::uint64_t seen = 0;
+    for (size_t b = 0; b < kLatencyBuckets; ++b) {
+        seen += s.hist[b];
+        if (seen > want) return b ? std::uint64_t(1) << (b < 63 ? b : 63) : 0;
+    }
+    return 0;
+}
+
+// Fixed buckets (2^10 ns ~ 1 us up to 2^36 ns ~ 69 s) so every scrape has the
+// same label set and series can be aggregated across runs and hosts.
+bool write_prometheus_textfile(const std::filesystem::path& p, const std::vector<StageStats>& stages) {
+    auto tmp = p;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        auto counter = [&](const char* name, const char* help, auto value) {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+            for (auto& s : stages) out << name << "{stage=\"" << stage_name(s.stage) << "\"} " << value(s) << "\n";
+        };
+        auto seconds = [](std::uint64_t ns) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%.9f", (double)ns / 1e9);
+            return std::string(buf);
+        };
+        counter("sp_dedup_stage_files_total", "Files handled by the stage.",
+                [](const StageStats& s) { return std::to_string(s.files); });
+        counter("sp_dedup_stage_bytes_total", "Bytes handled by the stage.",
+                [](const StageStats& s) { return std::to_string(s.bytes); });
+        counter("sp_dedup_stage_wall_seconds_total", "Wall time spent in the stage.",
+                [&](const StageStats& s) { return seconds(s.wall_ns); });
+        counter("sp_dedup_stage_cpu_seconds_total", "Process CPU time (all threads) while the stage ran.",
+                [&](const StageStats& s) { return seconds(s.cpu_ns); });
+
+        const char* h = "sp_dedup_stage_latency_seconds";
+        out << "# HELP " << h << " Per-item latency of the stage.\n# TYPE " << h << " histogram\n";
+        for (auto& s : stages) {
+            if (!s.items) continue;
+            const char* name = stage_name(s.stage);
+            std::uint64_t cum = 0;
+            for (size_t b = 0; b <= 10; ++b) cum += s.hist[b];
+            for (size_t b = 10; b <= 36; ++b) {
+                if (b > 10) cum += s.hist[b];
+                char le[32];
+                std::snprintf(le, sizeof(le), "%g", (double)(std::uint64_t(1) << b) / 1e9);
+                out << h << "_bucket{stage=\"" << name << "\",le=\"" << le << "\"} " << cum << "\n";
+            }
+            out << h << "_bucket{stage=\"" << name << "\",le=\"+Inf\"} " << s.items << "\n"
+                << h << "_sum{stage=\"" << name << "\"} " << seconds(s.latency_ns) << "\n"
+                << h << "_count{stage=\"" << name << "\"} " << s.items << "\n";
+        }
+
+        out << "# HELP sp_dedup_last_run_timestamp_seconds When these statistics were written.\n"
+            << "# TYPE sp_dedup_last_run_timestamp_seconds gauge\n"
+            << "sp_dedup_last_run_timestamp_seconds " << (long long)std::time(nullptr) << "\n";
+        out.flush();
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, p, ec);
+    if (!ec) return true;
+    std::filesystem::remove(tmp, ec);
+    return false;
+}
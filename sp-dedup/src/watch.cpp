@@ -0,0 +1,367 @@
+#include "watch.h"
+
+#ifdef __linux__
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    namespace fs = std::filesystem;
+    using Clock = std::chrono::steady_clock;
+
+    volatile std::sig_atomic_t g_stop = 0;
+    void on_signal(int) { g_stop = 1; }
+
+    const std::uint32_t kDirEvents = IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM |
+                                     IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR;
+
+    std::int64_t mtime_ns(const struct stat& st) {
+        return std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    /// Index key: files can only be duplicates within one (extension, size).
+    struct Key {
+        std::string ext;
+        std::uint64_t size;
+        bool operator==(const Key& o) const { return size == o.size && ext == o.ext; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            return std::hash<std::string>()(k.ext) ^ (size_t)(k.size * 0x9E3779B97F4A7C15ull);
+        }
+    };
+
+    struct Entry {
+        fs::path path;
+        std::uint64_t dev, ino;
+        std::int64_t mtime;                 // digest is valid for this mtime only
+        std::optional<Digest> digest;       // computed when a same-size file shows up
+    };
+
+    class Watcher {
+    public:
+        Watcher(const WatchOptions& o, Reporter& out) : opt_(o), out_(out) {}
+        ~Watcher() { if (fd_ >= 0) ::close(fd_); }
+
+        int run(const std::vector<FileInfo>& initial) {
+            timespec ts{};
+            ::clock_gettime(CLOCK_REALTIME, &ts);
+            started_ = std::int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+            fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (fd_ < 0) {
+                out_.error(ReportError::Watch, opt_.root, std::string("inotify_init1: ") + std::strerror(errno));
+                return 4;
+            }
+            watch_dirs(opt_.root);
+            for (auto& f : initial) insert(f.path, f.size, f.dev, f.ino, 0, std::nullopt);
+            out_.notice("Watching " + opt_.root.string() + " (" + std::to_string(index_.size()) +
+                        " size groups indexed). Ctrl-C to stop.");
+            out_.flush();
+
+            std::signal(SIGINT, on_signal);
+            std::signal(SIGTERM, on_signal);
+            const auto debounce = std::chrono::milliseconds(opt_.debounce_ms);
+            while (!g_stop) {
+                // Idle: block until the kernel has events. Otherwise wake when
+                // the quietest pending path is due.
+                int timeout = -1;
+                if (!pending_.empty()) {
+                    auto due = std::min_element(pending_.begin(), pending_.end(),
+                                                [](auto& a, auto& b) { return a.second < b.second; })->second + debounce;
+                    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count();
+                    timeout = (int)std::max<long long>(0, left + 1);
+                }
+                pollfd pfd{fd_, POLLIN, 0};
+                int r = ::poll(&pfd, 1, timeout);
+                if (r < 0) {
+                    if (errno == EINTR) continue;
+                    out_.error(ReportError::Watch, opt_.root, std::string("poll: ") + std::strerror(errno));
+                    return 4;
+                }
+                if (r > 0) drain();
+                auto now = Clock::now();
+                std::vector<std::string> due;
+                for (auto& [p, t] : pending_) if (now - t >= debounce) due.push_back(p);
+                std::sort(due.begin(), due.end());
+                for (auto& p : due) {
+                    pending_.erase(p);
+                    handle(fs::path(p));
+                }
+            }
+            out_.notice("Watch stopped. Duplicate sets: " + std::to_string(dupSets_) + ", " +
+                        (opt_.action == DedupAction::Delete ? "files removable: " : "files shareable: ") +
+                        std::to_string(removable_));
+            out_.flush();
+            return 0;
+        }
+
+    private:
+        bool wanted(const fs::path& p) const {
+            return opt_.only_ext.empty() || opt_.only_ext.count(p.extension().string());
+        }
+
+        void add_watch(const fs::path& dir) {
+            int wd = ::inotify_add_watch(fd_, dir.c_str(), kDirEvents);
+            if (wd >= 0) { dirs_[wd] = dir; return; }
+            if (!warned_) {
+                out_.error(ReportError::WatchDir, dir, std::string(std::strerror(errno)) +
+                           (errno == ENOSPC ? "; raise fs.inotify.max_user_watches" : ""));
+                warned_ = true;
+            }
+        }
+
+        void watch_dirs(const fs::path& top) {
+            add_watch(top);
+            if (!opt_.recurse) return;
+            std::error_code ec;
+            fs::recursive_directory_iterator it(top, fs::directory_options::skip_permission_denied, ec), end;
+            for (; !ec && it != end; it.increment(ec)) {
+                if (it->is_directory(ec) && !it->is_symlink(ec)) add_watch(it->path());
+            }
+        }
+
+        void insert(const fs::path& p, std::uint64_t size, std::uint64_t dev, std::uint64_t ino,
+                    std::int64_t mtime, std::optional<Digest> digest) {
+            if (!wanted(p)) return;
+            Key k{p.extension().string(), size};
+            index_[k].push_back({p, dev, ino, mtime, digest});
+            where_.emplace(p.string(), std::move(k));
+        }
+
+        void erase(const std::string& p) {
+            auto w = where_.find(p);
+            if (w == where_.end()) return;
+            auto b = index_.find(w->second);
+            if (b != index_.end()) {
+                auto& v = b->second;
+                v.erase(std::remove_if(v.begin(), v.end(), [&](const Entry& e) { return e.path.string() == p; }), v.end());
+                if (v.empty()) index_.erase(b);
+            }
+            where_.erase(w);
+        }
+
+        // A directory left the tree: forget everything below it.
+        void erase_under(const fs::path& dir) {
+            auto prefix = dir.string() + "/";
+            std::vector<std::string> gone;
+            for (auto& [p, k] : where_) if (p.compare(0, prefix.size(), prefix) == 0) gone.push_back(p);
+            for (auto& p : gone) erase(p);
+            for (auto it = pending_.begin(); it != pending_.end(); ) {
+                if (it->first.compare(0, prefix.size(), prefix) == 0) it = pending_.erase(it);
+                else ++it;
+            }
+        }
+
+        void drain() {
+            alignas(inotify_event) char buf[64 * 1024];
+            const auto now = Clock::now();
+            for (;;) {
+                ssize_t n = ::read(fd_, buf, sizeof(buf));
+                if (n <= 0) break;
+                for (char* p = buf; p < buf + n; ) {
+                    auto* e = reinterpret_cast<inotify_event*>(p);
+                    p += sizeof(inotify_event) + e->len;
+                    if (e->mask & IN_Q_OVERFLOW) { rescan(); continue; }
+                    auto d = dirs_.find(e->wd);
+                    if (d == dirs_.end()) continue;
+                    if (e->mask & IN_IGNORED) { dirs_.erase(d); continue; }
+                    if (!e->len) continue;
+                    fs::path path = d->second / e->name;
+                    if (e->mask & IN_ISDIR) {
+                        if (e->mask & (IN_MOVED_FROM | IN_DELETE)) erase_under(path);
+                        if (opt_.recurse && (e->mask & (IN_CREATE | IN_MOVED_TO))) {
+                            // files may have landed before the watch did
+                            watch_dirs(path);
+                            walk_target_files(path, true, {}, 1, [&](FileInfo&& f) { pending_[f.path.string()] = now; });
+                        }
+                        continue;
+                    }
+                    if (e->mask & (IN_MOVED_FROM | IN_DELETE)) {
+                        erase(path.string());
+                        pending_.erase(path.string());
+                    } else {
+                        pending_[path.string()] = now;     // restarts the quiet period
+                    }
+                }
+            }
+        }
+
+        // Events were lost: re-watch every directory (a directory already
+        // watched keeps its descriptor), forget indexed files that are gone and
+        // queue every file that is new or changed since it was indexed, so it
+        // goes through handle() once quiet like any other event.
+        void rescan() {
+            out_.error(ReportError::WatchOverflow, opt_.root);
+            watch_dirs(opt_.root);
+            const auto now = Clock::now();
+            std::unordered_set<std::string> present;
+            walk_target_files(opt_.root, opt_.recurse, {}, 1, [&](FileInfo&& f) {
+                auto p = f.path.string();
+                present.insert(p);
+                if (wanted(f.path) && !pending_.count(p) && !indexed_as_is(f)) pending_[p] = now;
+            });
+            std::vector<std::string> gone;
+            for (auto& [p, k] : where_) if (!present.count(p)) gone.push_back(p);
+            for (auto& p : gone) erase(p);
+        }
+
+        // Whether `f` is indexed and unchanged since. Files from the initial
+        // scan carry no mtime; they count as changed if modified after run().
+        bool indexed_as_is(const FileInfo& f) const {
+            auto w = where_.find(f.path.string());
+            if (w == where_.end() || w->second.size != f.size) return false;
+            auto b = index_.find(w->second);
+            if (b == index_.end()) return false;
+            struct stat st{};
+            if (::lstat(f.path.c_str(), &st) != 0) return false;
+            for (auto& e : b->second) {
+                if (e.path != f.path) continue;
+                if (e.ino != (std::uint64_t)st.st_ino) return false;
+                return e.mtime ? e.mtime == mtime_ns(st) : mtime_ns(st) < started_;
+            }
+            return false;
+        }
+
+        void handle(const fs::path& p) {
+            erase(p.string());
+            struct stat st{};
+            if (!wanted(p) || ::lstat(p.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return;   // symlinks skipped
+            const std::uint64_t size = (std::uint64_t)st.st_size;
+            const std::uint64_t dev = (std::uint64_t)st.st_dev, ino = (std::uint64_t)st.st_ino;
+            std::optional<Digest> mine;
+            bool gone = false;
+            auto b = index_.find(Key{p.extension().string(), size});
+            if (b != index_.end()) {
+                auto& bucket = b->second;
+                for (size_t i = 0; i < bucket.size(); ) {
+                    Entry& e = bucket[i];
+                    struct stat es{};
+                    if (::stat(e.path.c_str(), &es) != 0 || (std::uint64_t)es.st_size != size) {
+                        // gone or resized; its own event re-indexes it if it still exists
+                        where_.erase(e.path.string());
+                        bucket.erase(bucket.begin() + i);
+                        continue;
+                    }
+                    if (mtime_ns(es) != e.mtime || (std::uint64_t)es.st_ino != e.ino) {
+                        e.mtime = mtime_ns(es);
+                        e.dev = (std::uint64_t)es.st_dev;
+                        e.ino = (std::uint64_t)es.st_ino;
+                        e.digest.reset();
+                    }
+                    if (e.dev == dev && e.ino == ino) break;       // a hard link: already one file
+                    try {
+                        if (!mine) mine = hash_file(p, opt_.hash);
+                    } catch (...) {
+                        out_.error(ReportError::Hash, p);
+                        gone = true;
+                        break;
+                    }
+                    try {
+                        if (!e.digest) e.digest = hash_file(e.path, opt_.hash);
+                    } catch (...) {
+                        ++i;
+                        continue;
+                    }
+                    Outcome r = *e.digest == *mine ? act(e.path, p, size, *mine) : Outcome::Differs;
+                    if (r == Outcome::Differs) {
+                        ++i;
+                        continue;
+                    }
+                    // One KEEP per new file: the first match settles it, acted on or not.
+                    gone = r == Outcome::Gone;
+                    break;
+                }
+                if (bucket.empty()) index_.erase(b);
+            }
+            if (!gone) insert(p, size, dev, ino, mtime_ns(st), mine);
+        }
+
+        enum class Outcome {
+            Differs,    // not a copy of KEEP after all; try the next entry
+            Kept,       // reported (and acted on, if it failed or is a reflink); `dup` is still a file
+            Gone,       // deleted or relinked; its own events bring it back if needed
+        };
+
+        // Report `dup` as a duplicate of `keep` and apply the action.
+        Outcome act(const fs::path& keep, const fs::path& dup, std::uint64_t size, const Digest& d) {
+            if (opt_.commit && opt_.action != DedupAction::Reflink &&
+                (opt_.verify || !hash_algo_is_cryptographic(opt_.hash)) && !files_identical(keep, dup)) {
+                out_.error(ReportError::DigestCollision, dup, hash_algo_name(opt_.hash));
+                return Outcome::Differs;
+            }
+            ++dupSets_;
+            DuplicateSetRecord rec;
+            rec.ext = dup.extension().string();
+            rec.size = size;
+            rec.algo = digest_name(opt_.hash, size);
+            rec.digest = digest_hex(d, opt_.hash);
+            rec.action = opt_.action;
+            rec.members.push_back({SetMember::Keep, keep});
+            bool ok = true, skipped = false;
+            std::string why;
+            if (opt_.commit) {
+                std::error_code ec;
+                switch (opt_.action) {
+                    case DedupAction::Delete:
+                        ok = delete_file(dup);
+                        break;
+                    case DedupAction::Hardlink:
+                        ok = hardlink_replace(keep, dup, ec);
+                        if (!ok) why = ec.message();
+                        break;
+                    case DedupAction::Reflink: {
+                        auto r = reflink_dedupe(keep, {dup});
+                        skipped = r[0] == ReflinkStatus::Differs;
+                        ok = r[0] == ReflinkStatus::Shared;
+                        if (!ok) why = "FIDEDUPERANGE failed";
+                        break;
+                    }
+                }
+            }
+            if (skipped) rec.members.push_back({SetMember::Skipped, dup, false, "content differs from KEEP"});
+            else if (!ok) rec.members.push_back({SetMember::Failed, dup, false, why});
+            else rec.members.push_back({SetMember::Acted, dup});
+            out_.duplicate_set(rec);
+            out_.flush();
+            if (skipped) return Outcome::Differs;
+            if (!ok) return Outcome::Kept;
+            ++removable_;
+            // A relinked path comes back through its own events; a reflinked one stays.
+            return opt_.commit && opt_.action != DedupAction::Reflink ? Outcome::Gone : Outcome::Kept;
+        }
+
+        const WatchOptions& opt_;
+        Reporter& out_;
+        int fd_ = -1;
+        bool warned_ = false;
+        std::int64_t started_ = 0;                                          // wall clock at run(), ns
+        std::unordered_map<int, fs::path> dirs_;                            // watch descriptor -> directory
+        std::unordered_map<Key, std::vector<Entry>, KeyHash> index_;
+        std::unordered_map<std::string, Key> where_;                        // path -> its index key
+        std::unordered_map<std::string, Clock::time_point> pending_;        // path -> last event
+        size_t dupSets_ = 0, removable_ = 0;
+    };
+}
+
+int watch_tree(const WatchOptions& opt, const std::vector<FileInfo>& initial, Reporter& out) {
+    return Watcher(opt, out).run(initial);
+}
+
+#else
+
+int watch_tree(const WatchOptions& opt, const std::vector<FileInfo>&, Reporter& out) {
+    out.error(ReportError::Watch, opt.root, "needs inotify, only available on Linux");
+    return 4;
+}
+
+#endif
@@ -1,7 +1,9 @@
 #include "xlsx_dedup.h"
 #include "zip_util.h"
 #include "hasher.h"
+#include "stats.h"
 #include <tinyxml2.h>
+#include <cstring>
 #include <unordered_set>
 #include <sstream>
 
@@ -11,15 +13,15 @@ using namespace tinyxml2;
 // and dedupes identical rows by the concatenation of all <v> values.
 // For production, you'd resolve sharedStrings & data types.
 
-static std::string row_fingerprint(tinyxml2::XMLElement* row) {
-    // concat inner text of all <v> nodes inside the row
-    std::string s;
+static Digest row_fingerprint(tinyxml2::XMLElement* row) {
+    // digest of the inner text of all <v> nodes inside the row, each followed by '|'
+    Sha256Hasher& h = thread_sha256();
     for (auto* c = row->FirstChildElement(); c; c = c->NextSiblingElement()) {
         for (auto* v = c->FirstChildElement("v"); v; v = v->NextSiblingElement("v")) {
-            if (const char* t = v->GetText()) { s += t; s.push_back('|'); }
+            if (const char* t = v->GetText()) { h.update(t, std::strlen(t)); h.update("|", 1); }
         }
     }
-    return sha256_hex(s);
+    return h.finish();
 }
 
 bool xlsx_dedupe_rows_inplace(const std::filesystem::path& xlsx, bool commit, std::string& report) {
@@ -30,7 +32,12 @@ bool xlsx_dedupe_rows_inplace(const std::filesystem::path& xlsx, bool commit, st
     }
 
     tinyxml2::XMLDocument d;
-    if (d.Parse(xml.c_str(), xml.size()) != XML_SUCCESS) {
+    tinyxml2::XMLError parsed;
+    {
+        StageTimer timer(Stage::XmlParse, xml.size());
+        parsed = d.Parse(xml.c_str(), xml.size());
+    }
+    if (parsed != XML_SUCCESS) {
         report += "  [WARN] XML parse failed — skipping.\n";
         return false;
     }
@@ -40,13 +47,13 @@ bool xlsx_dedupe_rows_inplace(const std::filesystem::path& xlsx, bool commit, st
     auto* sheetData = ws->FirstChildElement("sheetData");
     if (!sheetData) { report += "  [WARN] No sheetData.\n"; return false; }
 
-    std::unordered_set<std::string> seen;
+    std::unordered_set<Digest, DigestHash> seen;
     std::vector<tinyxml2::XMLElement*> toDelete;
 
-    for (auto* row = sheetData->FirstChildElement("row"); row; row = row->NextSiblingElement("row")) {
-        std::string fp = row_fingerprint(row);
-        if (!fp.empty()) {
-            if (!seen.insert(fp).second) toDelete.push_back(row);
+    {
+        StageTimer timer(Stage::XmlDedupe, xml.size());
+        for (auto* row = sheetData->FirstChildElement("row"); row; row = row->NextSiblingElement("row")) {
+            if (!seen.insert(row_fingerprint(row)).second) toDelete.push_back(row);
         }
     }
 
@@ -60,7 +67,11 @@ bool xlsx_dedupe_rows_inplace(const std::filesystem::path& xlsx, bool commit, st
     if (commit) {
         for (auto* r : toDelete) sheetData->DeleteChild(r);
         tinyxml2::XMLPrinter pr;
-        d.Print(&pr);
+        {
+            StageTimer timer(Stage::XmlWrite);
+            d.Print(&pr);
+            timer.bytes((std::uint64_t)pr.CStrSize() - 1);
+        }
         if (!zip_write_file_replace(xlsx.string(), "xl/worksheets/sheet1.xml", pr.CStr())) {
             report += "  [ERR] Failed to write sheet1.xml back.\n";
             return false;
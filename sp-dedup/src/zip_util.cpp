@@ -1,4 +1,5 @@
 #include "zip_util.h"
+#include "stats.h"
 #include <minizip/zip.h>
 #include <minizip/unzip.h>
 #include <cstdio>
@@ -20,6 +21,7 @@ static bool read_whole_file(unzFile uf, std::string& out) {
 }
 
 bool zip_read_file(const std::string& zipPath, const std::string& innerPath, std::string& out) {
+    StageTimer timer(Stage::ZipRead);
     unzFile uf = unzOpen64(zipPath.c_str());
     if (!uf) return false;
     bool ok = false;
@@ -27,6 +29,7 @@ bool zip_read_file(const std::string& zipPath, const std::string& innerPath, std
         UNZ_OK == unzOpenCurrentFile(uf)) {
         ok = read_whole_file(uf, out);
         unzCloseCurrentFile(uf);
+        timer.bytes(out.size());
     }
     unzClose(uf);
     return ok;
@@ -49,6 +52,7 @@ std::vector<std::string> zip_list_files(const std::string& zipPath) {
 
 // Replace one entry by rebuilding the archive to a temp file (simple & safe).
 bool zip_write_file_replace(const std::string& zipPath, const std::string& innerPath, const std::string& content) {
+    StageTimer timer(Stage::ZipWrite, content.size());
     auto tmp = zipPath + ".tmp";
     unzFile in = unzOpen64(zipPath.c_str());
     if (!in) return false;
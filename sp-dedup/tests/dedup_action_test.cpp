@@ -0,0 +1,136 @@
+// Destructive actions against symlinks and hard links, in a scratch directory
+// under the system temp directory. Exits non-zero if any check fails.
+#include "dedup_action.h"
+#include "session.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const char* what) {
+        std::printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+        if (!ok) ++failures;
+    }
+
+    std::string slurp(const fs::path& p) {
+        std::ifstream in(p, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void spit(const fs::path& p, const std::string& data) {
+        std::ofstream(p, std::ios::binary) << data;
+    }
+
+    std::string payload() {
+        std::mt19937_64 rng(42);
+        std::string s(100000, '\0');
+        for (auto& c : s) c = (char)rng();
+        return s;
+    }
+
+    // A fresh, empty directory; removed again by the destructor.
+    struct Scratch {
+        fs::path dir;
+        explicit Scratch(const char* name) {
+            dir = fs::temp_directory_path() / ("sp_dedup_test_" + std::string(name));
+            fs::remove_all(dir);
+            fs::create_directories(dir);
+        }
+        ~Scratch() {
+            std::error_code ec;
+            fs::remove_all(dir, ec);
+        }
+    };
+
+    // false if this system (or account) cannot create symlinks.
+    bool make_symlink(const fs::path& target, const fs::path& link) {
+        std::error_code ec;
+        fs::create_symlink(target, link, ec);
+        if (ec) std::printf("skip: symlinks unavailable (%s)\n", ec.message().c_str());
+        return !ec;
+    }
+
+    void hardlink_replace_refuses_symlinks() {
+        Scratch s("symlink");
+        const std::string data = payload();
+        spit(s.dir / "data.bin", data);
+        if (!make_symlink("data.bin", s.dir / "link.bin")) return;
+
+        std::error_code ec;
+        check(!hardlink_replace(s.dir / "link.bin", s.dir / "data.bin", ec) && ec,
+              "hardlink_replace refuses a symlink KEEP");
+        check(slurp(s.dir / "data.bin") == data, "  the symlink's target keeps its data");
+        check(!hardlink_replace(s.dir / "data.bin", s.dir / "link.bin", ec) && ec,
+              "hardlink_replace refuses a symlink DUP");
+        check(fs::is_symlink(s.dir / "link.bin"), "  the symlink is left alone");
+    }
+
+    void hardlink_replace_refuses_same_inode() {
+        Scratch s("same_inode");
+        const std::string data = payload();
+        spit(s.dir / "data.bin", data);
+        fs::create_hard_link(s.dir / "data.bin", s.dir / "hard.bin");
+
+        std::error_code ec;
+        check(!hardlink_replace(s.dir / "data.bin", s.dir / "hard.bin", ec) && ec == std::errc::file_exists,
+              "hardlink_replace refuses two paths to one inode");
+        check(slurp(s.dir / "data.bin") == data && slurp(s.dir / "hard.bin") == data,
+              "  both paths keep their data");
+        check(std::distance(fs::directory_iterator(s.dir), fs::directory_iterator()) == 2,
+              "  no temp link is left behind");
+    }
+
+    void hardlink_replace_links_copies() {
+        Scratch s("copy");
+        const std::string data = payload();
+        spit(s.dir / "data.bin", data);
+        spit(s.dir / "copy.bin", data);
+
+        std::error_code ec;
+        check(hardlink_replace(s.dir / "data.bin", s.dir / "copy.bin", ec) && !ec,
+              "hardlink_replace links a copy");
+        check(fs::equivalent(s.dir / "data.bin", s.dir / "copy.bin") && slurp(s.dir / "copy.bin") == data,
+              "  the copy is now the same file");
+    }
+
+    // The walk must not mistake a symlink (or a second hard link) for a copy
+    // of the file it names, whatever the action. Without `hard` the target has
+    // a single link, so only the symlink check can tell the two paths apart.
+    void session_keeps_linked_data(DedupAction action, bool hard) {
+        Scratch s(dedup_action_name(action));
+        const std::string data = payload();
+        spit(s.dir / "data.bin", data);
+        if (hard) fs::create_hard_link(s.dir / "data.bin", s.dir / "hard.bin");
+        if (!make_symlink("data.bin", s.dir / "link.bin")) return;
+
+        ScanOptions opt;
+        opt.commit = true;
+        opt.action = action;
+        Reporter quiet;
+        DedupSession session(opt, quiet);
+        bool ok = session.add_root(s.dir) && session.scan();
+        std::string what = std::string("--commit --action=") + dedup_action_name(action) +
+                           (hard ? " leaves a symlink and hard links alone" : " leaves a symlink alone");
+        check(ok && session.summary().removable == 0, what.c_str());
+        check(slurp(s.dir / "data.bin") == data && slurp(s.dir / "link.bin") == data &&
+              (!hard || slurp(s.dir / "hard.bin") == data), "  every path still reads the data");
+    }
+}
+
+int main() {
+    hardlink_replace_refuses_symlinks();
+    hardlink_replace_refuses_same_inode();
+    hardlink_replace_links_copies();
+    for (bool hard : {false, true}) {
+        session_keeps_linked_data(DedupAction::Delete, hard);
+        session_keeps_linked_data(DedupAction::Hardlink, hard);
+    }
+    std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
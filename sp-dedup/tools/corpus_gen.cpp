@@ -0,0 +1,444 @@
+// Seeded synthetic corpus for scale testing sp_dedup. Every file is a pure
+// function of (seed, index), so a given seed always produces the same tree,
+// byte for byte, whatever the thread count: file i picks its kind, size and
+// whether it is a copy of an earlier file from its own PRNG stream, and a
+// copy takes its kind, size and content seed from the file it copies.
+#include "parallel.h"
+#include <minizip/zip.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+enum Kind { Txt, Bin, Docx, Xlsx, KindCount };
+const char* const kExt[KindCount] = {".txt", ".bin", ".docx", ".xlsx"};
+
+enum class SizeDist { Fixed, Uniform, LogNormal };
+
+struct Options {
+    fs::path out;
+    std::uint64_t seed = 1;
+    std::uint64_t files = 10000;
+    SizeDist dist = SizeDist::LogNormal;
+    double size_a = 16384, size_b = 1.5;    // fixed: a | uniform: [a,b] | lognormal: median a, sigma b
+    std::uint64_t max_size = std::uint64_t(64) << 20;
+    double dup_ratio = 0.3;                 // share of files that copy an earlier file
+    unsigned fanout = 16;                   // subdirectories per directory
+    std::uint64_t files_per_dir = 256;
+    unsigned mix[KindCount] = {50, 30, 10, 10};   // relative weights of txt,bin,docx,xlsx
+    double repeat = 0.25;                   // share of repeated paragraphs (docx) / rows (xlsx)
+    double sparse = 0.0;                    // share of .bin files written with holes
+    unsigned threads = default_thread_count();
+};
+
+// splitmix64: tiny, fast and specified exactly, unlike <random> distributions.
+struct Rng {
+    std::uint64_t s;
+    std::uint64_t next() {
+        std::uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    double unit() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }
+    std::uint64_t below(std::uint64_t n) { return n ? next() % n : 0; }
+};
+
+std::uint64_t stream_seed(std::uint64_t seed, std::uint64_t i, std::uint64_t salt) {
+    Rng r{seed ^ (i * 0xD1B54A32D192ED03ull) ^ salt};
+    return r.next();
+}
+
+struct Spec {
+    Kind kind;
+    std::uint64_t size;         // bytes for txt/bin; scales paragraph/row count for docx/xlsx
+    std::uint64_t content;      // seed of the content stream
+    bool sparse;
+    bool copy;                  // this file duplicates an earlier one
+};
+
+// What file i would be if it were not a copy.
+Spec own_spec(const Options& o, std::uint64_t i, bool& dup, std::uint64_t& src) {
+    Rng r{stream_seed(o.seed, i, 0x5EC)};
+    dup = i > 0 && r.unit() < o.dup_ratio;
+    src = r.below(i);
+
+    Spec s{};
+    unsigned total = 0;
+    for (unsigned w : o.mix) total += w;
+    std::uint64_t pick = r.below(total);
+    for (int k = 0; k < KindCount; ++k) {
+        if (pick < o.mix[k]) { s.kind = (Kind)k; break; }
+        pick -= o.mix[k];
+    }
+
+    double size = o.size_a;
+    if (o.dist == SizeDist::Uniform) {
+        size = o.size_a + std::floor(r.unit() * (o.size_b - o.size_a + 1));
+    } else if (o.dist == SizeDist::LogNormal) {
+        // Box-Muller; u1 is kept away from 0 so log() stays finite.
+        double u1 = r.unit() * (1.0 - 1e-12) + 1e-12, u2 = r.unit();
+        double z = std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+        size = std::round(o.size_a * std::exp(o.size_b * z));
+    }
+    s.size = (std::uint64_t)std::min<double>(std::max(size, 0.0), (double)o.max_size);
+    s.sparse = s.kind == Bin && r.unit() < o.sparse;
+    s.content = stream_seed(o.seed, i, 0xC0DE);
+    return s;
+}
+
+/// Follow copy links back to the original; the chain is geometric in dup_ratio.
+Spec resolve(const Options& o, std::uint64_t i) {
+    bool dup = false, first = true, copy = false;
+    std::uint64_t src = 0;
+    for (;;) {
+        Spec s = own_spec(o, i, dup, src);
+        if (first) { copy = dup; first = false; }
+        if (!dup) { s.copy = copy; return s; }
+        i = src;
+    }
+}
+
+/// Directory of file i: the directory number written in base `fanout`, one
+/// level per digit, so the tree stays balanced at any size.
+fs::path dir_of(const Options& o, std::uint64_t i) {
+    std::uint64_t d = i / o.files_per_dir;
+    std::vector<unsigned> digits;
+    while (d) { digits.push_back((unsigned)(d % o.fanout)); d /= o.fanout; }
+    fs::path p = o.out;
+    for (auto it = digits.rbegin(); it != digits.rend(); ++it) p /= "d" + std::to_string(*it);
+    return p;
+}
+
+const char* const kWords[] = {
+    "the", "quarterly", "report", "shows", "revenue", "growth", "across", "all", "regions",
+    "and", "the", "board", "approved", "budget", "for", "next", "year", "with", "minor",
+    "changes", "to", "staffing", "plans", "customer", "feedback", "was", "positive",
+    "overall", "although", "delivery", "times", "remain", "a", "concern", "in", "some",
+    "markets", "please", "review", "attached", "figures", "before", "meeting", "on",
+    "Monday", "project", "timeline", "risk", "owner", "status", "update", "pending",
+};
+constexpr size_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+std::string sentence(Rng& r) {
+    std::string s;
+    unsigned n = 6 + (unsigned)r.below(15);
+    for (unsigned w = 0; w < n; ++w) {
+        if (w) s += ' ';
+        s += kWords[r.below(kWordCount)];
+    }
+    s += '.';
+    return s;
+}
+
+std::string text_bytes(const Spec& s) {
+    Rng r{s.content};
+    std::string out;
+    out.reserve((size_t)s.size + 160);
+    while (out.size() < s.size) { out += sentence(r); out += '\n'; }
+    out.resize((size_t)s.size);
+    return out;
+}
+
+void fill_bytes(Rng& r, char* p, size_t n) {
+    for (size_t k = 0; k < n; k += 8) {
+        std::uint64_t v = r.next();
+        std::memcpy(p + k, &v, std::min<size_t>(8, n - k));
+    }
+}
+
+bool write_bin(const fs::path& p, const Spec& s) {
+    std::ofstream out(p, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    Rng r{s.content};
+    std::vector<char> block(1 << 16);
+    for (std::uint64_t off = 0, idx = 0; off < s.size; off += block.size(), ++idx) {
+        size_t n = (size_t)std::min<std::uint64_t>(block.size(), s.size - off);
+        fill_bytes(r, block.data(), n);
+        // Sparse files keep one block in sixteen plus the last; the rest are
+        // holes, which read back as zeros.
+        if (s.sparse && idx % 16 != 0 && off + n < s.size) continue;
+        out.seekp((std::streamoff)off);
+        out.write(block.data(), (std::streamsize)n);
+    }
+    return (bool)out;
+}
+
+bool write_zip(const fs::path& p, const std::vector<std::pair<const char*, std::string>>& entries) {
+    // Default zip_fileinfo leaves the timestamps zero, which keeps output reproducible.
+    zipFile zf = zipOpen64(p.string().c_str(), 0);
+    if (!zf) return false;
+    bool ok = true;
+    for (auto& [name, data] : entries) {
+        zip_fileinfo zi{};
+        if (ZIP_OK != zipOpenNewFileInZip64(zf, name, &zi, nullptr, 0, nullptr, 0, nullptr,
+                                            Z_DEFLATED, Z_DEFAULT_COMPRESSION, 0)) { ok = false; break; }
+        if (!data.empty() && ZIP_OK != zipWriteInFileInZip(zf, data.data(), (unsigned)data.size())) ok = false;
+        if (ZIP_OK != zipCloseFileInZip(zf)) ok = false;
+        if (!ok) break;
+    }
+    if (ZIP_OK != zipClose(zf, nullptr)) ok = false;
+    return ok;
+}
+
+const char* kRels =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+    "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"%s\"/>"
+    "</Relationships>";
+
+std::string package_rels(const char* target) {
+    std::string s = kRels;
+    s.replace(s.find("%s"), 2, target);
+    return s;
+}
+
+/// Paragraphs repeat an earlier paragraph of the same document with probability o.repeat.
+bool write_docx(const fs::path& p, const Spec& s, const Options& o) {
+    Rng r{s.content};
+    size_t n = (size_t)std::max<std::uint64_t>(1, std::min<std::uint64_t>(s.size / 100, 200000));
+    std::vector<std::string> paras;
+    paras.reserve(n);
+    std::string body;
+    for (size_t k = 0; k < n; ++k) {
+        if (k && r.unit() < o.repeat) paras.push_back(paras[(size_t)r.below(k)]);
+        else paras.push_back(sentence(r));
+        body += "<w:p><w:r><w:t>" + paras.back() + "</w:t></w:r></w:p>";
+    }
+    std::string doc =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<w:document xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\"><w:body>" +
+        body + "<w:sectPr/></w:body></w:document>";
+    std::string types =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+        "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+        "<Override PartName=\"/word/document.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.document.main+xml\"/>"
+        "</Types>";
+    return write_zip(p, {{"[Content_Types].xml", types},
+                         {"_rels/.rels", package_rels("word/document.xml")},
+                         {"word/document.xml", doc}});
+}
+
+/// Rows of five numeric cells; a row repeats an earlier one with probability o.repeat.
+bool write_xlsx(const fs::path& p, const Spec& s, const Options& o) {
+    constexpr int kCols = 5;
+    Rng r{s.content};
+    size_t n = (size_t)std::max<std::uint64_t>(1, std::min<std::uint64_t>(s.size / 60, 200000));
+    std::vector<std::uint32_t> vals(n * kCols);
+    std::string data;
+    for (size_t k = 0; k < n; ++k) {
+        std::uint32_t* row = &vals[k * kCols];
+        if (k && r.unit() < o.repeat) std::memcpy(row, &vals[(size_t)r.below(k) * kCols], sizeof(*row) * kCols);
+        else for (int c = 0; c < kCols; ++c) row[c] = (std::uint32_t)r.below(100000);
+        std::string ref = std::to_string(k + 1);
+        data += "<row r=\"" + ref + "\">";
+        for (int c = 0; c < kCols; ++c)
+            data += "<c r=\"" + std::string(1, char('A' + c)) + ref + "\"><v>" + std::to_string(row[c]) + "</v></c>";
+        data += "</row>";
+    }
+    std::string sheet =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\"><sheetData>" +
+        data + "</sheetData></worksheet>";
+    std::string workbook =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<workbook xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" "
+        "xmlns:r=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships\">"
+        "<sheets><sheet name=\"Sheet1\" sheetId=\"1\" r:id=\"rId1\"/></sheets></workbook>";
+    std::string wb_rels =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet\" Target=\"worksheets/sheet1.xml\"/>"
+        "</Relationships>";
+    std::string types =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+        "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+        "<Override PartName=\"/xl/workbook.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml\"/>"
+        "<Override PartName=\"/xl/worksheets/sheet1.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml\"/>"
+        "</Types>";
+    return write_zip(p, {{"[Content_Types].xml", types},
+                         {"_rels/.rels", package_rels("xl/workbook.xml")},
+                         {"xl/workbook.xml", workbook},
+                         {"xl/_rels/workbook.xml.rels", wb_rels},
+                         {"xl/worksheets/sheet1.xml", sheet}});
+}
+
+bool write_file(const fs::path& p, const Spec& s, const Options& o) {
+    switch (s.kind) {
+    case Txt: {
+        std::string bytes = text_bytes(s);
+        std::ofstream out(p, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), (std::streamsize)bytes.size());
+        return (bool)out;
+    }
+    case Bin:  return write_bin(p, s);
+    case Docx: return write_docx(p, s, o);
+    case Xlsx: return write_xlsx(p, s, o);
+    default:   return false;
+    }
+}
+
+void usage() {
+    std::cout <<
+        "Usage:\n"
+        "  sp_dedup_corpus <out-directory> [--seed=N] [--files=N]\n"
+        "               [--size=fixed:BYTES|uniform:MIN:MAX|lognormal:MEDIAN:SIGMA]\n"
+        "               [--max-size=BYTES] [--dup-ratio=F] [--fanout=N] [--files-per-dir=N]\n"
+        "               [--mix=txt:50,bin:30,docx:10,xlsx:10] [--repeat=F] [--sparse=F]\n"
+        "               [--threads=N]\n"
+        "The same options and seed always produce byte-identical trees.\n"
+        "Example:\n"
+        "  sp_dedup_corpus /scratch/c1m --seed=7 --files=1000000 --dup-ratio=0.2 --sparse=0.1\n";
+}
+
+bool parse_uint(const std::string& s, std::uint64_t& out) {
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos) return false;
+    try { out = std::stoull(s); } catch (...) { return false; }
+    return true;
+}
+
+bool parse_double(const std::string& s, double& out) {
+    if (s.empty() || s.find_first_not_of("0123456789.") != std::string::npos) return false;
+    try { out = std::stod(s); } catch (...) { return false; }
+    return true;
+}
+
+bool parse_fraction(const std::string& s, double& out) {
+    return parse_double(s, out) && out <= 1.0;
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, sep)) parts.push_back(item);
+    return parts;
+}
+
+bool parse_size_dist(const std::string& s, Options& o) {
+    auto p = split(s, ':');
+    std::uint64_t a = 0, b = 0;
+    if (p.size() == 2 && p[0] == "fixed" && parse_uint(p[1], a)) {
+        o.dist = SizeDist::Fixed; o.size_a = (double)a; return true;
+    }
+    if (p.size() == 3 && p[0] == "uniform" && parse_uint(p[1], a) && parse_uint(p[2], b) && a <= b) {
+        o.dist = SizeDist::Uniform; o.size_a = (double)a; o.size_b = (double)b; return true;
+    }
+    double sigma = 0;
+    if (p.size() == 3 && p[0] == "lognormal" && parse_uint(p[1], a) && parse_double(p[2], sigma)) {
+        o.dist = SizeDist::LogNormal; o.size_a = (double)a; o.size_b = sigma; return true;
+    }
+    return false;
+}
+
+bool parse_mix(const std::string& s, Options& o) {
+    unsigned mix[KindCount] = {};
+    for (auto& part : split(s, ',')) {
+        auto kv = split(part, ':');
+        std::uint64_t w = 0;
+        if (kv.size() != 2 || !parse_uint(kv[1], w) || w > 1000000) return false;
+        int k = 0;
+        while (k < KindCount && kv[0] != kExt[k] + 1) ++k;
+        if (k == KindCount) return false;
+        mix[k] = (unsigned)w;
+    }
+    unsigned total = 0;
+    for (unsigned w : mix) total += w;
+    if (!total) return false;
+    std::copy(mix, mix + KindCount, o.mix);
+    return true;
+}
+
+std::optional<Options> parse(int argc, char** argv) {
+    if (argc < 2 || argv[1][0] == '-') { usage(); return std::nullopt; }
+    Options o; o.out = fs::path(argv[1]);
+    for (int i = 2; i < argc; i++) {
+        std::string s = argv[i];
+        auto value = [&](const char* opt) { return s.substr(std::strlen(opt)); };
+        std::uint64_t n = 0;
+        bool ok = true;
+        if (s.rfind("--seed=", 0) == 0) ok = parse_uint(value("--seed="), o.seed);
+        else if (s.rfind("--files=", 0) == 0) ok = parse_uint(value("--files="), o.files);
+        else if (s.rfind("--size=", 0) == 0) ok = parse_size_dist(value("--size="), o);
+        else if (s.rfind("--max-size=", 0) == 0) ok = parse_uint(value("--max-size="), o.max_size);
+        else if (s.rfind("--dup-ratio=", 0) == 0) ok = parse_fraction(value("--dup-ratio="), o.dup_ratio) && o.dup_ratio < 1.0;
+        else if (s.rfind("--fanout=", 0) == 0) {
+            ok = parse_uint(value("--fanout="), n) && n >= 2 && n <= 65536;
+            o.fanout = (unsigned)n;
+        }
+        else if (s.rfind("--files-per-dir=", 0) == 0) ok = parse_uint(value("--files-per-dir="), o.files_per_dir) && o.files_per_dir > 0;
+        else if (s.rfind("--mix=", 0) == 0) ok = parse_mix(value("--mix="), o);
+        else if (s.rfind("--repeat=", 0) == 0) ok = parse_fraction(value("--repeat="), o.repeat);
+        else if (s.rfind("--sparse=", 0) == 0) ok = parse_fraction(value("--sparse="), o.sparse);
+        else if (s.rfind("--threads=", 0) == 0) {
+            ok = parse_uint(value("--threads="), n) && n > 0;
+            o.threads = (unsigned)std::min<std::uint64_t>(n, 1024);
+        }
+        else { usage(); return std::nullopt; }
+        if (!ok) { std::cerr << "Bad value: " << s << "\n"; return std::nullopt; }
+    }
+    return o;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    auto parsed = parse(argc, argv);
+    if (!parsed) return 2;
+    const Options& o = *parsed;
+
+    // Leftovers from another run would make the tree differ from what the seed describes.
+    std::error_code ec;
+    if (fs::exists(o.out, ec) && !fs::is_empty(o.out, ec)) {
+        std::cerr << "Output directory is not empty: " << o.out.string() << "\n";
+        return 2;
+    }
+
+    // Directories first, in one thread, so the writers never race on creation.
+    std::uint64_t dirs = o.files ? (o.files - 1) / o.files_per_dir + 1 : 1;
+    for (std::uint64_t d = 0; d < dirs; ++d) {
+        fs::create_directories(dir_of(o, d * o.files_per_dir), ec);
+        if (ec) { std::cerr << "Cannot create directory: " << ec.message() << "\n"; return 3; }
+    }
+
+    std::atomic<std::uint64_t> count[KindCount] = {}, bytes{0}, copies{0}, sparse{0}, failed{0};
+    parallel_for((size_t)o.files, o.threads, [&](size_t i) {
+        Spec s = resolve(o, i);
+        fs::path p = dir_of(o, i) / ("f" + std::to_string(i) + kExt[s.kind]);
+        bool ok = false;
+        try { ok = write_file(p, s, o); } catch (...) {}
+        if (!ok) { failed.fetch_add(1, std::memory_order_relaxed); return; }
+        count[s.kind].fetch_add(1, std::memory_order_relaxed);
+        copies.fetch_add(s.copy, std::memory_order_relaxed);
+        sparse.fetch_add(s.sparse, std::memory_order_relaxed);
+        if (s.kind == Txt || s.kind == Bin) bytes.fetch_add(s.size, std::memory_order_relaxed);
+        else { std::error_code fec; bytes.fetch_add(fs::file_size(p, fec), std::memory_order_relaxed); }
+    });
+
+    std::cout << "Files written: " << (o.files - failed.load()) << " in " << dirs << " directories\n";
+    for (int k = 0; k < KindCount; ++k) std::cout << "  " << kExt[k] << ": " << count[k].load() << "\n";
+    std::cout << "Bytes (logical): " << bytes.load() << "\n";
+    std::cout << "Copies of an earlier file: " << copies.load() << "\n";
+    std::cout << "Sparse files: " << sparse.load() << "\n";
+    if (failed.load()) {
+        std::cerr << "Failed to write: " << failed.load() << " files\n";
+        return 3;
+    }
+    return 0;
+}